@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+#include <x86intrin.h>
+
+/*
+Minimal timing helpers shared by the micro benchmarks. Timings are in TSC
+ticks; each sample covers a batch of operations so the fencing overhead of
+rdtsc is amortised.
+*/
+
+inline __attribute__((always_inline)) uint64_t tsc_start() noexcept {
+    _mm_lfence();
+    return __rdtsc();
+}
+
+inline __attribute__((always_inline)) uint64_t tsc_stop() noexcept {
+    unsigned aux;
+    const uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+
+template <typename T> inline __attribute__((always_inline)) void
+do_not_optimize(const T &value) noexcept {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct CycleStats {
+    double mean = 0;
+    double p50 = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double p999 = 0;
+};
+
+// Per-operation cycle statistics from per-batch samples
+inline CycleStats summarise(std::vector<uint64_t> samples,
+                            std::size_t ops_per_sample) noexcept {
+    CycleStats stats;
+    if (samples.empty())
+        return stats;
+
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (uint64_t s : samples)
+        total += static_cast<double>(s);
+
+    const double per_op = 1.0 / static_cast<double>(ops_per_sample);
+    stats.mean = total / static_cast<double>(samples.size()) * per_op;
+    stats.p50 = samples[samples.size() / 2] * per_op;
+    stats.p90 = samples[samples.size() * 90 / 100] * per_op;
+    stats.p99 = samples[samples.size() * 99 / 100] * per_op;
+    stats.p999 = samples[samples.size() * 999 / 1000] * per_op;
+    return stats;
+}
+
+inline void print_stats(const char *name, const CycleStats &stats) noexcept {
+    std::printf("%-36s mean %8.2f  p50 %8.2f  p99 %8.2f  cycles/op\n", name,
+                stats.mean, stats.p50, stats.p99);
+}
+
+/*
+One hardware counter for the calling thread via perf_event_open, so the
+benches don't need PAPI. valid() is false when the kernel or VM doesn't
+expose the event; read() then returns 0.
+*/
+class PerfCounter {
+  private:
+    int fd_ = -1;
+
+  public:
+    PerfCounter(uint32_t type, uint64_t config) noexcept {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(
+            syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~PerfCounter() {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+    PerfCounter(const PerfCounter &) = delete;
+    PerfCounter &operator=(const PerfCounter &) = delete;
+
+    bool valid() const noexcept { return fd_ >= 0; }
+
+    uint64_t read() const noexcept {
+        uint64_t value = 0;
+        if (fd_ < 0 || ::read(fd_, &value, sizeof(value)) != sizeof(value))
+            return 0;
+        return value;
+    }
+};
+
+// Touches every line of `scratch` to push a working set out of cache
+inline void evict_caches(std::vector<char> &scratch) noexcept {
+    for (std::size_t i = 0; i < scratch.size(); i += 64)
+        scratch[i] += 1;
+    do_not_optimize(scratch.data());
+}
@@ -0,0 +1,436 @@
+#include "../decreasing_array.h"
+#include "../level_queues.h"
+#include "bench_util.h"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <pthread.h>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+Standalone microbenchmarks for the book's two containers, each against
+alternative layouts, so container changes can be judged without the rest of
+the engine.
+
+Price ladder (best = lowest key, as the engine stores it):
+  sorted_array  DecreasingSortedArray, best at back()
+  bitmap        one bit per price plus a summary word per 64 words
+  chunked       B-tree-of-arrays: sorted 64-key chunks under a sorted
+                chunk directory
+  cases: near_touch (insert within 8 ticks of the best), far_touch
+  (insert anywhere in the range), each step being pop + insert + back,
+  and back (best lookups only)
+
+Level queues (32 ids per level):
+  pooled        LevelQueues, blocks taken from a pool per live level
+  ring          a wrapping 32-slot ring embedded per level
+  deque         std::deque per level, the allocator-backed baseline
+  cases: one_level (FIFO churn on one level), scattered (push/pop over 64
+  levels spread across the range)
+
+Every case replays one pregenerated operation stream, so all
+implementations do identical work. Each case runs REPS timed repetitions
+after a warm-up on a pinned CPU; the table shows median and minimum
+cycles/op and the coefficient of variation across repetitions.
+
+usage: container_bench [filter]   (runs cases whose name contains filter)
+*/
+
+static constexpr uint32_t NUM_PRICES = 8192;
+static constexpr uint32_t SLOTS = 32;
+static constexpr int REPS = 15;
+static constexpr std::size_t LADDER_LEVELS = 1000;
+static constexpr std::size_t LADDER_STEPS = 200000;
+static constexpr std::size_t QUEUE_OPS = 1 << 20;
+
+// ---------------------------------------------------------------- ladders
+
+class SortedArrayLadder {
+    DecreasingSortedArray<int16_t, NUM_PRICES> prices_;
+
+  public:
+    void insert(int16_t price) { prices_.insert(static_cast<int16_t>(price)); }
+    int16_t best() const { return prices_.back(); }
+    void pop_best() { prices_.pop_back(); }
+};
+
+class BitmapLadder {
+    static constexpr uint32_t WORDS = NUM_PRICES / 64;
+    std::array<uint64_t, WORDS> words_{};
+    std::array<uint64_t, WORDS / 64> summary_{};
+
+  public:
+    void insert(int16_t price) {
+        const uint32_t w = price / 64;
+        words_[w] |= 1ull << (price % 64);
+        summary_[w / 64] |= 1ull << (w % 64);
+    }
+    int16_t best() const {
+        const uint32_t s = summary_[0] ? 0 : 1;
+        const uint32_t w = s * 64 + __builtin_ctzll(summary_[s]);
+        return static_cast<int16_t>(w * 64 + __builtin_ctzll(words_[w]));
+    }
+    void pop_best() {
+        const uint32_t price = best();
+        const uint32_t w = price / 64;
+        words_[w] &= words_[w] - 1; // clears the lowest set bit
+        if (!words_[w])
+            summary_[w / 64] &= ~(1ull << (w % 64));
+    }
+};
+static_assert(NUM_PRICES / 64 / 64 == 2, "BitmapLadder::best scans 2 words");
+
+// Descending like DecreasingSortedArray: chunk order_[i] holds keys greater
+// than chunk order_[i + 1], so the best key is the back of the last chunk.
+class ChunkedLadder {
+    static constexpr uint32_t CHUNK = 64;
+    // Chunks are at least half full after a split, plus one partial
+    static constexpr uint32_t MAX_CHUNKS = NUM_PRICES / (CHUNK / 2) + 1;
+
+    struct Chunk {
+        std::array<int16_t, CHUNK> keys;
+        uint32_t count;
+    };
+    std::array<Chunk, MAX_CHUNKS> chunks_;
+    std::array<uint16_t, MAX_CHUNKS> order_;
+    std::array<uint16_t, MAX_CHUNKS> free_;
+    uint32_t num_chunks_ = 0, num_free_ = MAX_CHUNKS;
+
+    uint16_t new_chunk() {
+        const uint16_t c = free_[--num_free_];
+        chunks_[c].count = 0;
+        return c;
+    }
+
+    static void insert_into(Chunk &chunk, int16_t key) {
+        uint32_t pos = chunk.count;
+        while (pos > 0 && key > chunk.keys[pos - 1])
+            --pos;
+        std::memmove(&chunk.keys[pos + 1], &chunk.keys[pos],
+                     (chunk.count - pos) * sizeof(int16_t));
+        chunk.keys[pos] = key;
+        ++chunk.count;
+    }
+
+  public:
+    ChunkedLadder() {
+        for (uint32_t i = 0; i < MAX_CHUNKS; ++i)
+            free_[i] = static_cast<uint16_t>(MAX_CHUNKS - 1 - i);
+    }
+
+    void insert(int16_t key) {
+        if (num_chunks_ == 0) {
+            order_[0] = new_chunk();
+            num_chunks_ = 1;
+        }
+        // Last chunk (scanning from the best end) whose largest key is not
+        // below `key`, or the first chunk
+        uint32_t i = num_chunks_ - 1;
+        while (i > 0 && key > chunks_[order_[i]].keys[0])
+            --i;
+
+        Chunk *chunk = &chunks_[order_[i]];
+        if (chunk->count == CHUNK) {
+            // Split: the smaller half moves to a new chunk right after i
+            const uint16_t c = new_chunk();
+            Chunk &upper = chunks_[c];
+            upper.count = CHUNK / 2;
+            std::memcpy(upper.keys.data(), &chunk->keys[CHUNK / 2],
+                        CHUNK / 2 * sizeof(int16_t));
+            chunk->count = CHUNK / 2;
+            std::memmove(&order_[i + 2], &order_[i + 1],
+                         (num_chunks_ - i - 1) * sizeof(uint16_t));
+            order_[i + 1] = c;
+            ++num_chunks_;
+            if (key < chunk->keys[CHUNK / 2 - 1])
+                chunk = &upper;
+        }
+        insert_into(*chunk, key);
+    }
+    int16_t best() const {
+        const Chunk &last = chunks_[order_[num_chunks_ - 1]];
+        return last.keys[last.count - 1];
+    }
+    void pop_best() {
+        Chunk &last = chunks_[order_[num_chunks_ - 1]];
+        if (--last.count == 0)
+            free_[num_free_++] = order_[--num_chunks_];
+    }
+};
+
+// Distinct prices to insert: the initial fill, then one per steady-state
+// step (each step pops the best, inserts, reads the new best). Generated
+// against a reference bitmap so every ladder sees a valid stream.
+struct LadderStream {
+    std::vector<int16_t> fill;
+    std::vector<int16_t> steps;
+};
+
+static LadderStream make_ladder_stream(bool near_touch) {
+    std::mt19937 rng(11);
+    BitmapLadder ref;
+    std::vector<bool> present(NUM_PRICES);
+    LadderStream stream;
+
+    auto add = [&](std::vector<int16_t> &out, int price) {
+        present[price] = true;
+        ref.insert(static_cast<int16_t>(price));
+        out.push_back(static_cast<int16_t>(price));
+    };
+
+    std::uniform_int_distribution<int> anywhere(0, NUM_PRICES - 1);
+    while (stream.fill.size() < LADDER_LEVELS) {
+        const int p = anywhere(rng);
+        if (!present[p])
+            add(stream.fill, p);
+    }
+
+    // Popping first and inserting around the new best keeps the best on a
+    // random walk instead of drifting in one direction
+    std::uniform_int_distribution<int> near(-8, 8);
+    while (stream.steps.size() < LADDER_STEPS) {
+        present[ref.best()] = false;
+        ref.pop_best();
+
+        const int best = ref.best();
+        int p = -1;
+        for (int tries = 0; near_touch && tries < 64; ++tries) {
+            const int candidate = best + near(rng);
+            if (candidate >= 0 && candidate < static_cast<int>(NUM_PRICES) &&
+                !present[candidate]) {
+                p = candidate;
+                break;
+            }
+        }
+        while (p < 0 || present[p]) // far touch, or a saturated touch
+            p = anywhere(rng);
+        add(stream.steps, p);
+    }
+    return stream;
+}
+
+// Sum of the best price after every step, to check the ladders agree
+template <typename Ladder>
+static int64_t ladder_checksum(const LadderStream &stream) {
+    auto ladder = std::make_unique<Ladder>();
+    for (int16_t p : stream.fill)
+        ladder->insert(p);
+    int64_t sum = 0;
+    for (int16_t p : stream.steps) {
+        ladder->pop_best();
+        ladder->insert(p);
+        sum += ladder->best();
+    }
+    return sum;
+}
+
+template <typename Ladder>
+static uint64_t run_ladder_steps(const LadderStream &stream) {
+    auto ladder = std::make_unique<Ladder>();
+    for (int16_t p : stream.fill)
+        ladder->insert(p);
+
+    int64_t sum = 0;
+    const uint64_t t0 = tsc_start();
+    for (int16_t p : stream.steps) {
+        ladder->pop_best();
+        ladder->insert(p);
+        sum += ladder->best();
+    }
+    const uint64_t t1 = tsc_stop();
+    do_not_optimize(sum);
+    return t1 - t0;
+}
+
+template <typename Ladder>
+static uint64_t run_ladder_back(const LadderStream &stream) {
+    auto ladder = std::make_unique<Ladder>();
+    for (int16_t p : stream.fill)
+        ladder->insert(p);
+
+    int64_t sum = 0;
+    const uint64_t t0 = tsc_start();
+    for (std::size_t i = 0; i < LADDER_STEPS; ++i) {
+        sum += ladder->best();
+        do_not_optimize(ladder); // reload the best every iteration
+    }
+    const uint64_t t1 = tsc_stop();
+    do_not_optimize(sum);
+    return t1 - t0;
+}
+
+// ----------------------------------------------------------------- queues
+
+using PooledQueues = LevelQueues<uint32_t, SLOTS, NUM_PRICES>;
+
+class PooledQueueSet {
+    std::unique_ptr<PooledQueues> queues_ = std::make_unique<PooledQueues>();
+
+  public:
+    void push(uint32_t level, uint32_t id) { (*queues_)[level].push_back(id); }
+    uint32_t pop(uint32_t level) {
+        auto queue = (*queues_)[level];
+        const uint32_t id = queue.front();
+        queue.pop_front();
+        return id;
+    }
+};
+
+class RingQueueSet {
+    struct Ring {
+        std::array<uint32_t, SLOTS> items;
+        uint8_t tail = 0, count = 0;
+    };
+    std::vector<Ring> rings_ = std::vector<Ring>(NUM_PRICES);
+
+  public:
+    void push(uint32_t level, uint32_t id) {
+        Ring &r = rings_[level];
+        r.items[(r.tail + r.count++) & (SLOTS - 1)] = id;
+    }
+    uint32_t pop(uint32_t level) {
+        Ring &r = rings_[level];
+        const uint32_t id = r.items[r.tail];
+        r.tail = (r.tail + 1) & (SLOTS - 1);
+        --r.count;
+        return id;
+    }
+};
+
+class DequeQueueSet {
+    std::vector<std::deque<uint32_t>> queues_ =
+        std::vector<std::deque<uint32_t>>(NUM_PRICES);
+
+  public:
+    void push(uint32_t level, uint32_t id) { queues_[level].push_back(id); }
+    uint32_t pop(uint32_t level) {
+        const uint32_t id = queues_[level].front();
+        queues_[level].pop_front();
+        return id;
+    }
+};
+
+// Level of each op, with the top bit set for pushes. Generated against
+// per-level counts so no push overflows and no pop finds a level empty.
+static std::vector<uint32_t> make_queue_stream(bool scattered) {
+    constexpr uint32_t PUSH = 1u << 31;
+    std::mt19937 rng(13);
+    std::vector<uint32_t> levels;
+    if (scattered) {
+        std::uniform_int_distribution<uint32_t> level(0, NUM_PRICES - 1);
+        for (int i = 0; i < 64; ++i)
+            levels.push_back(level(rng));
+    } else {
+        levels.push_back(NUM_PRICES / 2);
+    }
+
+    std::vector<uint32_t> count(NUM_PRICES), ops;
+    ops.reserve(QUEUE_OPS);
+    while (ops.size() < QUEUE_OPS) {
+        const uint32_t level = levels[rng() % levels.size()];
+        // Hover around half full, emptying now and then
+        const bool push = count[level] == 0 ||
+                          (count[level] < SLOTS && rng() % 32 >= count[level]);
+        count[level] += push ? 1 : -1;
+        ops.push_back(level | (push ? PUSH : 0));
+    }
+    return ops;
+}
+
+template <typename Queues>
+static uint64_t run_queues(const std::vector<uint32_t> &ops) {
+    Queues queues;
+    uint64_t sum = 0;
+    uint32_t next_id = 0;
+    const uint64_t t0 = tsc_start();
+    for (uint32_t op : ops) {
+        const uint32_t level = op & ~(1u << 31);
+        if (op >> 31)
+            queues.push(level, next_id++);
+        else
+            sum += queues.pop(level);
+    }
+    const uint64_t t1 = tsc_stop();
+    do_not_optimize(sum);
+    return t1 - t0;
+}
+
+// ------------------------------------------------------------------ driver
+
+template <typename Run>
+static void bench(const char *filter, const std::string &name,
+                  std::size_t ops, Run run) {
+    if (filter && name.find(filter) == std::string::npos)
+        return;
+
+    run(); // warm-up
+    std::vector<double> per_op;
+    for (int r = 0; r < REPS; ++r)
+        per_op.push_back(static_cast<double>(run()) / ops);
+    std::sort(per_op.begin(), per_op.end());
+
+    double mean = 0, var = 0;
+    for (double x : per_op)
+        mean += x / REPS;
+    for (double x : per_op)
+        var += (x - mean) * (x - mean) / REPS;
+    std::printf("%-32s %10.2f %10.2f %7.1f%% %10zu\n", name.c_str(),
+                per_op[REPS / 2], per_op[0], 100 * std::sqrt(var) / mean,
+                ops);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : nullptr;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(0, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    std::printf("%-32s %10s %10s %8s %10s\n", "case (cycles/op)", "median",
+                "min", "cv", "ops");
+
+    for (bool near_touch : {true, false}) {
+        const LadderStream stream = make_ladder_stream(near_touch);
+        const std::string shape = near_touch ? "near_touch" : "far_touch";
+        const int64_t expected = ladder_checksum<SortedArrayLadder>(stream);
+        if (ladder_checksum<BitmapLadder>(stream) != expected ||
+            ladder_checksum<ChunkedLadder>(stream) != expected) {
+            std::printf("ladders disagree on %s\n", shape.c_str());
+            return 1;
+        }
+        bench(filter, "ladder/sorted_array/" + shape, LADDER_STEPS,
+              [&] { return run_ladder_steps<SortedArrayLadder>(stream); });
+        bench(filter, "ladder/bitmap/" + shape, LADDER_STEPS,
+              [&] { return run_ladder_steps<BitmapLadder>(stream); });
+        bench(filter, "ladder/chunked/" + shape, LADDER_STEPS,
+              [&] { return run_ladder_steps<ChunkedLadder>(stream); });
+    }
+    {
+        const LadderStream stream = make_ladder_stream(false);
+        bench(filter, "ladder/sorted_array/back", LADDER_STEPS,
+              [&] { return run_ladder_back<SortedArrayLadder>(stream); });
+        bench(filter, "ladder/bitmap/back", LADDER_STEPS,
+              [&] { return run_ladder_back<BitmapLadder>(stream); });
+        bench(filter, "ladder/chunked/back", LADDER_STEPS,
+              [&] { return run_ladder_back<ChunkedLadder>(stream); });
+    }
+
+    for (bool scattered : {false, true}) {
+        const auto ops = make_queue_stream(scattered);
+        const std::string shape = scattered ? "scattered" : "one_level";
+        bench(filter, "queue/pooled/" + shape, ops.size(),
+              [&] { return run_queues<PooledQueueSet>(ops); });
+        bench(filter, "queue/ring/" + shape, ops.size(),
+              [&] { return run_queues<RingQueueSet>(ops); });
+        bench(filter, "queue/deque/" + shape, ops.size(),
+              [&] { return run_queues<DequeQueueSet>(ops); });
+    }
+    return 0;
+}
@@ -0,0 +1,105 @@
+#include "../engine.hpp"
+#include "../gateway.hpp"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+/*
+End-to-end loopback latency through the binary gateway. A client thread
+sends packets of `batch` requests over a unix SOCK_SEQPACKET socketpair to a
+gateway thread, which decodes, matches and answers each packet; one sample is
+the client's send-to-receive round trip. The same request stream is then run
+through Gateway::handle() directly, which is the in-process share of that
+time (decode, validation, matching, encode) without the socket calls and the
+thread hand-off.
+
+The stream is three new orders (a quarter of them crossing) to every cancel
+of an earlier order, with fresh ids, so one book serves a whole run.
+*/
+
+static constexpr PriceType MID = 1000;
+static constexpr std::size_t NUM_REQUESTS = 12'000;
+
+static std::vector<WireRequest> make_stream() {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> offset(-2, 8);
+    std::uniform_int_distribution<int> qty(1, 20);
+    std::vector<WireRequest> stream;
+    IdType next_id = 0;
+    while (stream.size() < NUM_REQUESTS) {
+        if (stream.size() % 4 == 3) {
+            std::uniform_int_distribution<IdType> earlier(0, next_id - 1);
+            stream.push_back(wire_modify(earlier(rng), 0));
+            continue;
+        }
+        const Side side = rng() & 1 ? Side::BUY : Side::SELL;
+        const int away = offset(rng);
+        const PriceType price = static_cast<PriceType>(
+            side == Side::BUY ? MID - away : MID + away);
+        stream.push_back(wire_new_order(
+            Order{next_id++, price, static_cast<QuantityType>(qty(rng)), side}));
+    }
+    return stream;
+}
+
+static void run(const std::vector<WireRequest> &stream, std::size_t batch) {
+    std::unique_ptr<Orderbook> book(create_orderbook());
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+        std::perror("socketpair");
+        return;
+    }
+    Gateway gateway(*book, fds[1]);
+    std::thread server([&gateway] {
+        while (gateway.poll() > 0) {
+        }
+    });
+
+    std::vector<WireResponse> responses(Gateway::MAX_BATCH);
+    std::vector<uint64_t> samples;
+    for (std::size_t i = 0; i + batch <= stream.size(); i += batch) {
+        const uint64_t t0 = tsc_start();
+        send(fds[0], &stream[i], batch * sizeof(WireRequest), 0);
+        recv(fds[0], responses.data(),
+             responses.size() * sizeof(WireResponse), 0);
+        samples.push_back(tsc_stop() - t0);
+    }
+    close(fds[0]);
+    server.join();
+    close(fds[1]);
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "round trip, batch %zu (per packet)",
+                  batch);
+    print_stats(name, summarise(samples, 1));
+    if (batch > 1) {
+        std::snprintf(name, sizeof(name),
+                      "round trip, batch %zu (per request)", batch);
+        print_stats(name, summarise(samples, batch));
+    }
+
+    // Same stream, no socket
+    std::unique_ptr<Orderbook> direct_book(create_orderbook());
+    Gateway direct(*direct_book, -1);
+    samples.clear();
+    for (std::size_t i = 0; i + batch <= stream.size(); i += batch) {
+        const uint64_t t0 = tsc_start();
+        direct.handle(&stream[i], batch, responses.data());
+        samples.push_back(tsc_stop() - t0);
+    }
+    std::snprintf(name, sizeof(name), "handle() only, batch %zu (per request)",
+                  batch);
+    print_stats(name, summarise(samples, batch));
+}
+
+int main() {
+    const std::vector<WireRequest> stream = make_stream();
+    for (std::size_t batch : {1, 8, 64})
+        run(stream, batch);
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "../book_scheduler.hpp"
+#include "../engine.hpp"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+/*
+Sequential match_order vs InterleavedMatcher over many books that together
+don't fit in cache. Each request picks a random book, so consecutive
+requests almost never share lines. Both runs replay the same request stream
+against identically seeded books, and the results are checked to match.
+
+Interleaving only wins when the dependent misses it overlaps cost more than
+the coroutine switches, about 60-100 cycles per op here (compare the two
+at 16 books, where everything is cached). On the 1-CPU VM behind the README
+numbers that no longer happens: sequential dispatch is faster at every
+in-flight count, from 16 books up to 1024.
+
+usage: interleave_bench [num_books=512] [num_requests=1000000]
+*/
+
+static constexpr PriceType MID = 4096;
+
+static std::vector<Orderbook *> make_books(std::size_t n) {
+    std::vector<Orderbook *> books(n);
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> offset(1, 50);
+    for (std::size_t b = 0; b < n; ++b) {
+        books[b] = create_orderbook();
+        for (IdType id = 0; id < 400; ++id) {
+            const Side side = id & 1 ? Side::SELL : Side::BUY;
+            const int off = offset(rng);
+            match_order(*books[b],
+                        Order{id,
+                              static_cast<PriceType>(
+                                  side == Side::BUY ? MID - off : MID + off),
+                              10, side});
+        }
+    }
+    return books;
+}
+
+static std::vector<MatchRequest>
+make_requests(const std::vector<Orderbook *> &books, std::size_t n) {
+    std::vector<MatchRequest> requests(n);
+    std::vector<IdType> next_id(books.size(), 400);
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<std::size_t> book(0, books.size() - 1);
+    std::uniform_int_distribution<int> offset(-8, 50);
+    std::uniform_int_distribution<int> qty(1, 30);
+    for (auto &r : requests) {
+        const std::size_t b = book(rng);
+        const Side side = rng() & 1 ? Side::SELL : Side::BUY;
+        const int off = offset(rng); // negative offsets cross the spread
+        IdType &id = next_id[b];
+        r.book = books[b];
+        r.order = Order{id, static_cast<PriceType>(
+                                side == Side::BUY ? MID - off : MID + off),
+                        static_cast<QuantityType>(qty(rng)), side};
+        id = id + 1 == MAX_ORDERS ? 0 : id + 1;
+    }
+    return requests;
+}
+
+static void report(const char *name, uint64_t cycles, std::size_t ops) {
+    std::printf("%-36s %8.2f cycles/op\n", name,
+                static_cast<double>(cycles) / ops);
+}
+
+static void free_books(std::vector<Orderbook *> &books) {
+    for (Orderbook *b : books)
+        delete b;
+}
+
+int main(int argc, char **argv) {
+    const std::size_t num_books = argc > 1 ? std::atoi(argv[1]) : 512;
+    const std::size_t num_requests = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    std::printf("%zu books (%.0f MB), %zu requests\n", num_books,
+                num_books * sizeof(Orderbook) / 1e6, num_requests);
+
+    std::vector<uint32_t> expected(num_requests), results(num_requests);
+
+    {
+        auto books = make_books(num_books);
+        const auto requests = make_requests(books, num_requests);
+        const uint64_t t0 = tsc_start();
+        for (std::size_t i = 0; i < num_requests; ++i)
+            expected[i] = match_order(*requests[i].book, requests[i].order);
+        const uint64_t t1 = tsc_stop();
+        report("sequential", t1 - t0, num_requests);
+        free_books(books);
+    }
+
+    for (uint32_t in_flight : {2u, 4u, 8u, 16u, 32u}) {
+        auto books = make_books(num_books);
+        const auto requests = make_requests(books, num_requests);
+        InterleavedMatcher matcher(in_flight);
+        const uint64_t t0 = tsc_start();
+        matcher.run(requests.data(), num_requests, results.data());
+        const uint64_t t1 = tsc_stop();
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "interleaved, %u in flight",
+                      in_flight);
+        report(name, t1 - t0, num_requests);
+        if (results != expected) {
+            std::printf("result mismatch against sequential dispatch\n");
+            return 1;
+        }
+        free_books(books);
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "../engine.hpp"
+#include "bench_util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+/*
+Match loop benchmark for deep levels and many partial fills. Each round
+fills LEVELS sell levels with MAX_ORDERS_PER_LEVEL orders whose ids are
+scattered over the whole order store, then sweeps them with buy orders
+sized to end every match on a partial fill. Caches are flushed before each
+timed match_order so the queued counter orders are genuinely cold.
+
+A second pass times the rest path from cold: single non-crossing orders
+added to a half-populated book, about half of them opening a new level, with
+the cache-miss counter read around each add.
+
+Build with -DENGINE_PREFETCH_DISTANCE=0 (make bench-match does both) to
+compare against the loop without look-ahead prefetches.
+*/
+
+static constexpr PriceType BASE = 1000;
+static constexpr PriceType LEVELS = 64;
+static constexpr QuantityType RESTING_QTY = 10;
+static constexpr QuantityType SWEEP_QTY = 95; // 9 full fills + 1 partial
+static constexpr int ROUNDS = 200;
+static constexpr int REST_ROUNDS = 40;
+static constexpr int RESTS_PER_ROUND = 64;
+
+int main() {
+    std::mt19937 rng(7);
+    std::vector<IdType> ids(MAX_ORDERS);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::vector<char> scratch(32 << 20);
+
+    PerfCounter cycles(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    PerfCounter stalls(PERF_TYPE_HARDWARE,
+                       PERF_COUNT_HW_STALLED_CYCLES_BACKEND);
+    PerfCounter misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    std::vector<uint64_t> samples;
+    uint64_t total_matches = 0, total_cycles = 0, total_stalls = 0;
+
+    for (int round = 0; round < ROUNDS; ++round) {
+        Orderbook *ob = create_orderbook();
+        std::shuffle(ids.begin(), ids.end(), rng);
+
+        std::size_t next = 0;
+        for (PriceType level = 0; level < LEVELS; ++level)
+            for (uint16_t k = 0; k < MAX_ORDERS_PER_LEVEL; ++k)
+                match_order(*ob, Order{ids[next++],
+                                       static_cast<PriceType>(BASE + level),
+                                       RESTING_QTY, Side::SELL});
+
+        const std::size_t resting = next * RESTING_QTY;
+        IdType buy_id = ids[next];
+        for (std::size_t swept = 0; swept + SWEEP_QTY <= resting;
+             swept += SWEEP_QTY) {
+            evict_caches(scratch);
+
+            const uint64_t c0 = cycles.read(), s0 = stalls.read();
+            const uint64_t t0 = tsc_start();
+            const uint32_t matches = match_order(
+                *ob, Order{buy_id, static_cast<PriceType>(BASE + LEVELS),
+                           SWEEP_QTY, Side::BUY});
+            const uint64_t t1 = tsc_stop();
+            total_cycles += cycles.read() - c0;
+            total_stalls += stalls.read() - s0;
+
+            total_matches += matches;
+            samples.push_back(t1 - t0);
+        }
+        delete ob;
+    }
+
+    std::printf("prefetch distance %u, %zu sweeps, %.2f matches/sweep\n",
+                PREFETCH_DISTANCE, samples.size(),
+                static_cast<double>(total_matches) / samples.size());
+    print_stats("match_order (cold, partial fills)", summarise(samples, 1));
+    if (cycles.valid() && stalls.valid())
+        std::printf("backend stall cycles %.1f%% of %.0f cycles/sweep\n",
+                    100.0 * total_stalls / total_cycles,
+                    static_cast<double>(total_cycles) / samples.size());
+    else
+        std::printf("backend stall counter unavailable\n");
+
+    // Cold rests: every other level below BASE already has one order, and
+    // each timed add lands on a random level in the same range
+    std::vector<uint64_t> rest_samples;
+    uint64_t total_misses = 0;
+    std::uniform_int_distribution<PriceType> price_dist(0, 2 * LEVELS - 1);
+    for (int round = 0; round < REST_ROUNDS; ++round) {
+        Orderbook *ob = create_orderbook();
+        std::shuffle(ids.begin(), ids.end(), rng);
+
+        std::size_t next = 0;
+        for (PriceType level = 0; level < 2 * LEVELS; level += 2)
+            match_order(*ob, Order{ids[next++],
+                                   static_cast<PriceType>(BASE - level),
+                                   RESTING_QTY, Side::BUY});
+
+        for (int k = 0; k < RESTS_PER_ROUND; ++k) {
+            const Order order{ids[next++],
+                              static_cast<PriceType>(BASE - price_dist(rng)),
+                              RESTING_QTY, Side::BUY};
+            evict_caches(scratch);
+
+            const uint64_t m0 = misses.read();
+            const uint64_t t0 = tsc_start();
+            match_order(*ob, order);
+            const uint64_t t1 = tsc_stop();
+            total_misses += misses.read() - m0;
+            rest_samples.push_back(t1 - t0);
+        }
+        delete ob;
+    }
+
+    print_stats("match_order (cold, rest only)", summarise(rest_samples, 1));
+    if (misses.valid())
+        std::printf("cache misses %.2f per rest\n",
+                    static_cast<double>(total_misses) / rest_samples.size());
+    else
+        std::printf("cache miss counter unavailable\n");
+    return 0;
+}
@@ -0,0 +1,490 @@
+#include "../engine.hpp"
+#include "bench_util.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <pthread.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Throughput matrix over workload shapes. Each configuration replays one
+random request stream (new limit orders and cancels) over a set of books,
+sharded across threads by book, and reports ops/s, per-op cycle
+percentiles and hardware counter deltas as CSV and optionally JSON.
+
+Axes: book count, thread count, price spread (incoming orders land within
+`spread` ticks of the mid, a quarter of them crossing), cancel ratio and
+resting depth (levels per side preloaded before timing). By default each
+axis is swept on its own around a baseline; --full runs the whole product.
+
+The stream is generated against shadow books so ids can be recycled and
+cancels only target live orders. An id is only reissued once it has left
+its level queue: a lazily cancelled order keeps its entry until the match
+loop trims it, and a new order under that id would be matched through the
+stale entry too. The timed books replay the stream from the same starting
+state, and the engine is deterministic, so every run of a configuration
+does identical work. After each run every level's volume is checked
+against the orders resting there, and a mismatch fails the benchmark.
+
+usage: matrix_bench [--full] [--ops N] [--csv path] [--json path]
+                    [--baseline path.csv] [--tolerance 0.10]
+
+With --baseline, exits 1 if any configuration present in the baseline CSV
+lost more than `tolerance` of its ops/s.
+*/
+
+static constexpr PriceType MID = 4096;
+static constexpr std::size_t BATCH = 32; // ops per timed sample
+
+struct Config {
+    std::size_t books;
+    std::size_t threads;
+    int spread;
+    double cancel_ratio;
+    int depth;
+};
+
+struct Request {
+    Order order;
+    uint32_t book;
+    bool cancel; // modify_order_by_id(order.id, 0)
+};
+
+struct Result {
+    double seconds = 0;
+    CycleStats cycles;
+    // Summed over threads; UINT64_MAX when the counter is unavailable
+    uint64_t instructions = 0, cpu_cycles = 0, cache_misses = 0,
+             branch_misses = 0;
+};
+
+static void preload(Orderbook &book, int depth) {
+    IdType id = 0;
+    for (int level = 1; level <= depth; ++level)
+        for (int k = 0; k < 2; ++k) {
+            match_order(book, Order{id++, static_cast<PriceType>(MID - level),
+                                    10, Side::BUY});
+            match_order(book, Order{id++, static_cast<PriceType>(MID + level),
+                                    10, Side::SELL});
+        }
+}
+
+// Ids the next orders of one shadow book can use, the ones it may still
+// have resting, and cancelled ones that may still be queued
+struct IdPool {
+    std::vector<IdType> free;
+    std::vector<IdType> live;
+    std::vector<IdType> retired;
+};
+
+// Moves ids whose orders have filled out of `live`, and ids in `retired`
+// whose queue entry has been trimmed, back to `free`
+static void reclaim(Orderbook &book, IdPool &ids) {
+    std::size_t kept = 0;
+    for (IdType id : ids.live) {
+        if (order_exists(book, id))
+            ids.live[kept++] = id;
+        else
+            ids.retired.push_back(id);
+    }
+    ids.live.resize(kept);
+    kept = 0;
+    for (IdType id : ids.retired) {
+        if (order_id_queued(book, id))
+            ids.retired[kept++] = id;
+        else
+            ids.free.push_back(id);
+    }
+    ids.retired.resize(kept);
+}
+
+static std::vector<Request> make_requests(const Config &config,
+                                          std::size_t num_ops) {
+    std::vector<Orderbook *> shadow(config.books);
+    std::vector<IdPool> pools(config.books);
+    for (std::size_t b = 0; b < config.books; ++b) {
+        shadow[b] = create_orderbook();
+        preload(*shadow[b], config.depth);
+        const IdType first = static_cast<IdType>(4 * config.depth);
+        for (IdType id = MAX_ORDERS; id-- > first;)
+            pools[b].free.push_back(id);
+        for (IdType id = 0; id < first; ++id)
+            pools[b].live.push_back(id);
+    }
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<std::size_t> pick_book(0, config.books - 1);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::uniform_int_distribution<int> offset(-config.spread / 4,
+                                              config.spread);
+    std::uniform_int_distribution<int> qty(1, 30);
+
+    std::vector<Request> requests;
+    requests.reserve(num_ops);
+    while (requests.size() < num_ops) {
+        const uint32_t b = static_cast<uint32_t>(pick_book(rng));
+        Orderbook &book = *shadow[b];
+        IdPool &ids = pools[b];
+
+        if (ids.free.empty())
+            reclaim(book, ids);
+        const bool cancel =
+            ids.free.empty() || coin(rng) < config.cancel_ratio;
+
+        if (cancel) {
+            if (ids.live.empty())
+                continue;
+            const std::size_t i = rng() % ids.live.size();
+            const IdType id = ids.live[i];
+            ids.live[i] = ids.live.back();
+            ids.live.pop_back();
+            ids.retired.push_back(id);
+            if (!order_exists(book, id))
+                continue; // already filled, nothing to cancel
+            modify_order_by_id(book, id, 0);
+            requests.push_back({Order{id, 0, 0, Side::BUY}, b, true});
+            continue;
+        }
+
+        const IdType id = ids.free.back();
+        ids.free.pop_back();
+        const Side side = rng() & 1 ? Side::SELL : Side::BUY;
+        const int off = offset(rng); // negative offsets cross the mid
+        const Order order{id,
+                          static_cast<PriceType>(side == Side::BUY ? MID - off
+                                                                   : MID + off),
+                          static_cast<QuantityType>(qty(rng)), side};
+        match_order(book, order);
+        (order_exists(book, id) ? ids.live : ids.free).push_back(id);
+        requests.push_back({order, b, false});
+    }
+
+    for (Orderbook *book : shadow)
+        delete book;
+    return requests;
+}
+
+static void pin_to_cpu(std::size_t index) {
+    const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+struct ThreadResult {
+    std::vector<uint64_t> samples;
+    uint64_t counters[4] = {};
+    bool valid[4] = {};
+};
+
+static void run_shard(const std::vector<Request> &requests,
+                      const std::vector<Orderbook *> &books,
+                      std::size_t index, std::atomic<bool> &go,
+                      ThreadResult &out) {
+    pin_to_cpu(index);
+    PerfCounter counters[4] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    };
+    out.samples.reserve(requests.size() / BATCH + 1);
+    while (!go.load(std::memory_order_acquire))
+        ;
+
+    uint64_t before[4];
+    for (int c = 0; c < 4; ++c)
+        before[c] = counters[c].read();
+
+    uint32_t sink = 0;
+    for (std::size_t i = 0; i < requests.size(); i += BATCH) {
+        const std::size_t end = std::min(i + BATCH, requests.size());
+        const uint64_t t0 = tsc_start();
+        for (std::size_t j = i; j < end; ++j) {
+            const Request &r = requests[j];
+            if (r.cancel)
+                modify_order_by_id(*books[r.book], r.order.id, 0);
+            else
+                sink += match_order(*books[r.book], r.order);
+        }
+        out.samples.push_back((tsc_stop() - t0) * BATCH / (end - i));
+    }
+    do_not_optimize(sink);
+
+    for (int c = 0; c < 4; ++c) {
+        out.valid[c] = counters[c].valid();
+        out.counters[c] = counters[c].read() - before[c];
+    }
+}
+
+static std::string config_key(const Config &c) {
+    char key[96];
+    std::snprintf(key, sizeof(key), "%zu,%zu,%d,%.2f,%d", c.books, c.threads,
+                  c.spread, c.cancel_ratio, c.depth);
+    return key;
+}
+
+// Counts levels whose volume is not the sum of the orders resting there
+// (`wrapped` counts those whose volume went below zero)
+static void check_book(Orderbook &book, std::size_t &mismatched,
+                       std::size_t &wrapped) {
+    std::vector<uint64_t> expected[2] = {
+        std::vector<uint64_t>(MAX_NUM_PRICES),
+        std::vector<uint64_t>(MAX_NUM_PRICES)};
+    for (IdType id = 0; id < MAX_ORDERS; ++id)
+        if (order_exists(book, id)) {
+            const Order order = lookup_order_by_id(book, id);
+            expected[static_cast<int>(order.side)][order.price - BASE_PRICE] +=
+                order.quantity;
+        }
+    for (Side side : {Side::BUY, Side::SELL})
+        for (std::size_t level = 0; level < MAX_NUM_PRICES; ++level) {
+            const VolumeType volume = get_volume_at_level(
+                book, side, static_cast<PriceType>(level + BASE_PRICE));
+            if (volume != expected[static_cast<int>(side)][level]) {
+                ++mismatched;
+                wrapped += volume > MAX_ORDERS * uint64_t{UINT16_MAX};
+            }
+        }
+}
+
+static Result run(const Config &config, const std::vector<Request> &requests) {
+    std::vector<Orderbook *> books(config.books);
+    for (Orderbook *&book : books) {
+        book = create_orderbook();
+        preload(*book, config.depth);
+    }
+
+    // Books are not shared between threads, so each shard replays its
+    // books' requests in stream order
+    std::vector<std::vector<Request>> shards(config.threads);
+    for (const Request &r : requests)
+        shards[r.book % config.threads].push_back(r);
+
+    std::vector<ThreadResult> results(config.threads);
+    std::vector<std::thread> threads;
+    std::atomic<bool> go{false};
+    for (std::size_t t = 0; t < config.threads; ++t)
+        threads.emplace_back(run_shard, std::cref(shards[t]),
+                             std::cref(books), t, std::ref(go),
+                             std::ref(results[t]));
+
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread &thread : threads)
+        thread.join();
+    const auto stop = std::chrono::steady_clock::now();
+
+    Result result;
+    result.seconds = std::chrono::duration<double>(stop - start).count();
+    std::vector<uint64_t> samples;
+    uint64_t *totals[4] = {&result.instructions, &result.cpu_cycles,
+                           &result.cache_misses, &result.branch_misses};
+    for (const ThreadResult &r : results) {
+        samples.insert(samples.end(), r.samples.begin(), r.samples.end());
+        for (int c = 0; c < 4; ++c)
+            *totals[c] = r.valid[c] && *totals[c] != UINT64_MAX
+                             ? *totals[c] + r.counters[c]
+                             : UINT64_MAX;
+    }
+    result.cycles = summarise(std::move(samples), BATCH);
+
+    std::size_t mismatched = 0, wrapped = 0;
+    for (Orderbook *book : books) {
+        check_book(*book, mismatched, wrapped);
+        delete book;
+    }
+    if (mismatched) {
+        std::fprintf(stderr,
+                     "inconsistent books at %s: %zu levels off their "
+                     "orders' volume, %zu wrapped\n",
+                     config_key(config).c_str(), mismatched, wrapped);
+        std::exit(3);
+    }
+    return result;
+}
+
+static std::vector<Config> make_matrix(bool full) {
+    const Config base{16, 1, 20, 0.3, 50};
+    const std::vector<std::size_t> books{1, 4, 16, 64, 256, 1024};
+    const std::vector<std::size_t> threads{1, 2, 4};
+    const std::vector<int> spreads{4, 20, 100, 500};
+    const std::vector<double> cancels{0.0, 0.3, 0.6, 0.9};
+    const std::vector<int> depths{0, 50, 500};
+
+    std::vector<Config> matrix;
+    if (full) {
+        for (auto b : books)
+            for (auto t : threads)
+                for (auto s : spreads)
+                    for (auto c : cancels)
+                        for (auto d : depths)
+                            matrix.push_back({b, t, s, c, d});
+        return matrix;
+    }
+
+    // One axis at a time around the baseline, baseline listed once
+    matrix.push_back(base);
+    for (auto b : books)
+        if (b != base.books)
+            matrix.push_back({b, base.threads, base.spread, base.cancel_ratio,
+                              base.depth});
+    for (auto t : threads)
+        if (t != base.threads)
+            matrix.push_back({base.books, t, base.spread, base.cancel_ratio,
+                              base.depth});
+    for (auto s : spreads)
+        if (s != base.spread)
+            matrix.push_back({base.books, base.threads, s, base.cancel_ratio,
+                              base.depth});
+    for (auto c : cancels)
+        if (c != base.cancel_ratio)
+            matrix.push_back(
+                {base.books, base.threads, base.spread, c, base.depth});
+    for (auto d : depths)
+        if (d != base.depth)
+            matrix.push_back(
+                {base.books, base.threads, base.spread, base.cancel_ratio, d});
+    return matrix;
+}
+
+static const char *CSV_HEADER =
+    "books,threads,spread,cancel_ratio,depth,ops,seconds,ops_per_sec,"
+    "cycles_mean,cycles_p50,cycles_p90,cycles_p99,cycles_p999,"
+    "instructions,cpu_cycles,cache_misses,branch_misses\n";
+
+// Empty in CSV / null in JSON when the counter is unavailable
+static std::string counter_field(uint64_t value, const char *missing) {
+    return value == UINT64_MAX ? missing : std::to_string(value);
+}
+
+static std::string csv_row(const Config &c, std::size_t ops, const Result &r) {
+    char row[256];
+    std::snprintf(row, sizeof(row),
+                  "%s,%zu,%.6f,%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,", config_key(c).c_str(),
+                  ops, r.seconds, ops / r.seconds, r.cycles.mean, r.cycles.p50,
+                  r.cycles.p90, r.cycles.p99, r.cycles.p999);
+    return row + counter_field(r.instructions, "") + "," +
+           counter_field(r.cpu_cycles, "") + "," +
+           counter_field(r.cache_misses, "") + "," +
+           counter_field(r.branch_misses, "") + "\n";
+}
+
+static std::string json_row(const Config &c, std::size_t ops,
+                            const Result &r) {
+    char row[512];
+    std::snprintf(
+        row, sizeof(row),
+        "{\"books\":%zu,\"threads\":%zu,\"spread\":%d,\"cancel_ratio\":%.2f,"
+        "\"depth\":%d,\"ops\":%zu,\"seconds\":%.6f,\"ops_per_sec\":%.0f,"
+        "\"cycles\":{\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+        "\"p999\":%.1f},",
+        c.books, c.threads, c.spread, c.cancel_ratio, c.depth, ops, r.seconds,
+        ops / r.seconds, r.cycles.mean, r.cycles.p50, r.cycles.p90,
+        r.cycles.p99, r.cycles.p999);
+    return row + std::string("\"counters\":{\"instructions\":") +
+           counter_field(r.instructions, "null") +
+           ",\"cpu_cycles\":" + counter_field(r.cpu_cycles, "null") +
+           ",\"cache_misses\":" + counter_field(r.cache_misses, "null") +
+           ",\"branch_misses\":" + counter_field(r.branch_misses, "null") +
+           "}}";
+}
+
+// ops/s per configuration key from a CSV this program wrote
+static std::map<std::string, double> load_baseline(const char *path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    if (!in) {
+        std::fprintf(stderr, "cannot read baseline %s\n", path);
+        std::exit(2);
+    }
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields;
+        std::stringstream row(line);
+        for (std::string field; std::getline(row, field, ',');)
+            fields.push_back(field);
+        if (fields.size() < 8)
+            continue;
+        baseline[fields[0] + "," + fields[1] + "," + fields[2] + "," +
+                 fields[3] + "," + fields[4]] = std::atof(fields[7].c_str());
+    }
+    return baseline;
+}
+
+int main(int argc, char **argv) {
+    bool full = false;
+    std::size_t num_ops = 200000;
+    const char *csv_path = nullptr, *json_path = nullptr,
+               *baseline_path = nullptr;
+    double tolerance = 0.10;
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--full"))
+            full = true;
+        else if (!std::strcmp(argv[i], "--ops") && has_value)
+            num_ops = std::strtoul(argv[++i], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--csv") && has_value)
+            csv_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--json") && has_value)
+            json_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--baseline") && has_value)
+            baseline_path = argv[++i];
+        else if (!std::strcmp(argv[i], "--tolerance") && has_value)
+            tolerance = std::atof(argv[++i]);
+        else {
+            std::fprintf(stderr, "unknown argument %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    const auto baseline = baseline_path
+                              ? load_baseline(baseline_path)
+                              : std::map<std::string, double>{};
+    std::string csv = CSV_HEADER, json = "[\n";
+    std::fputs(CSV_HEADER, stdout);
+
+    bool regressed = false;
+    const auto matrix = make_matrix(full);
+    // Untimed pass so the first row doesn't pay for warming up
+    run(matrix[0], make_requests(matrix[0], num_ops));
+
+    for (std::size_t i = 0; i < matrix.size(); ++i) {
+        const Config &config = matrix[i];
+        const auto requests = make_requests(config, num_ops);
+        const Result result = run(config, requests);
+
+        const std::string row = csv_row(config, requests.size(), result);
+        std::fputs(row.c_str(), stdout);
+        std::fflush(stdout);
+        csv += row;
+        json += "  " + json_row(config, requests.size(), result) +
+                (i + 1 < matrix.size() ? ",\n" : "\n");
+
+        const auto it = baseline.find(config_key(config));
+        const double ops_per_sec = requests.size() / result.seconds;
+        if (it != baseline.end() && ops_per_sec < it->second * (1 - tolerance)) {
+            std::fprintf(stderr, "regression at %s: %.0f ops/s vs %.0f\n",
+                         it->first.c_str(), ops_per_sec, it->second);
+            regressed = true;
+        }
+    }
+    json += "]\n";
+
+    if (csv_path)
+        std::ofstream(csv_path) << csv;
+    if (json_path)
+        std::ofstream(json_path) << json;
+    return regressed ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include "../engine.hpp"
+#include "../gateway.hpp"
+#include "../pipeline.hpp"
+#include "bench_util.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+Inline vs staged handling of one request stream. Inline runs
+Gateway::handle() and then the publish work on one thread; staged submits
+the same requests to a Pipeline with the risk, match and publish stages
+pinned to CPUs 1-3 (modulo the CPUs there are) and the parse stage on CPU 0.
+The publish work is the same in both: one write() of the responses to
+/dev/null per batch.
+
+Requests are submitted back to back in chunks of `chunk`, so the staged run
+is limited by its slowest stage and its rings fill up; latency is from a
+request's submission to the publishing of its response, queueing included.
+*/
+
+static constexpr PriceType MID = 1000;
+static constexpr std::size_t NUM_REQUESTS = 12'000;
+static constexpr int RUNS = 10;
+
+struct Timeline {
+    std::vector<uint64_t> submitted;
+    std::vector<uint64_t> published;
+    int devnull = -1;
+    uint32_t first_sequence = 0;
+};
+
+static void publish(const WireResponse *responses, std::size_t count,
+                    void *context) {
+    Timeline &timeline = *static_cast<Timeline *>(context);
+    if (write(timeline.devnull, responses, count * sizeof(WireResponse)) < 0)
+        std::perror("write");
+    const uint64_t now = __rdtsc();
+    for (std::size_t i = 0; i < count; ++i)
+        timeline.published[responses[i].sequence - timeline.first_sequence] =
+            now;
+}
+
+static std::vector<WireRequest> make_stream() {
+    std::mt19937 rng(13);
+    std::uniform_int_distribution<int> offset(-2, 8);
+    std::uniform_int_distribution<int> qty(1, 20);
+    std::vector<WireRequest> stream;
+    IdType next_id = 0;
+    while (stream.size() < NUM_REQUESTS) {
+        if (stream.size() % 4 == 3) {
+            std::uniform_int_distribution<IdType> earlier(0, next_id - 1);
+            stream.push_back(wire_modify(earlier(rng), 0));
+            continue;
+        }
+        const Side side = rng() & 1 ? Side::BUY : Side::SELL;
+        const int away = offset(rng);
+        const PriceType price = static_cast<PriceType>(
+            side == Side::BUY ? MID - away : MID + away);
+        stream.push_back(wire_new_order(
+            Order{next_id++, price, static_cast<QuantityType>(qty(rng)), side}));
+    }
+    return stream;
+}
+
+static int cpu(int index) {
+    return index % static_cast<int>(
+                       std::max(1u, std::thread::hardware_concurrency()));
+}
+
+static void report(const char *mode, std::size_t chunk, double seconds,
+                   const std::vector<uint64_t> &latencies) {
+    const CycleStats stats = summarise(latencies, 1);
+    std::printf("%-7s chunk %3zu  %6.2f Mreq/s  latency p50 %8.0f  p99 %8.0f"
+                "  p99.9 %8.0f cycles\n",
+                mode, chunk, RUNS * NUM_REQUESTS / seconds / 1e6, stats.p50,
+                stats.p99, stats.p999);
+}
+
+static void run(const std::vector<WireRequest> &stream, std::size_t chunk,
+                bool staged) {
+    Timeline timeline;
+    timeline.submitted.resize(stream.size());
+    timeline.published.resize(stream.size());
+    timeline.devnull = open("/dev/null", O_WRONLY);
+    pin_current_thread(cpu(0));
+
+    std::vector<uint64_t> latencies;
+    std::vector<WireResponse> responses(chunk);
+    double seconds = 0;
+    for (int r = 0; r < RUNS; ++r) {
+        std::unique_ptr<Orderbook> book(create_orderbook());
+        const auto start = std::chrono::steady_clock::now();
+        if (staged) {
+            auto pipeline = std::make_unique<Pipeline>(
+                *book, publish, &timeline,
+                Pipeline::Cpus{cpu(1), cpu(2), cpu(3)});
+            for (std::size_t i = 0; i + chunk <= stream.size(); i += chunk) {
+                const uint64_t now = __rdtsc();
+                for (std::size_t k = 0; k < chunk; ++k)
+                    timeline.submitted[i + k] = now;
+                pipeline->submit(&stream[i], chunk);
+            }
+            pipeline->drain();
+        } else {
+            Gateway gateway(*book, -1);
+            for (std::size_t i = 0; i + chunk <= stream.size(); i += chunk) {
+                const uint64_t now = __rdtsc();
+                for (std::size_t k = 0; k < chunk; ++k)
+                    timeline.submitted[i + k] = now;
+                gateway.handle(&stream[i], chunk, responses.data());
+                publish(responses.data(), chunk, &timeline);
+            }
+        }
+        seconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+        for (std::size_t i = 0; i < stream.size() / chunk * chunk; ++i)
+            latencies.push_back(timeline.published[i] - timeline.submitted[i]);
+    }
+    close(timeline.devnull);
+    report(staged ? "staged" : "inline", chunk, seconds, latencies);
+}
+
+int main() {
+    const std::vector<WireRequest> stream = make_stream();
+    std::printf("%u CPUs\n", std::thread::hardware_concurrency());
+    for (std::size_t chunk : {1, 32}) {
+        run(stream, chunk, false);
+        run(stream, chunk, true);
+    }
+    return 0;
+}
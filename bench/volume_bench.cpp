@@ -0,0 +1,102 @@
+#include "../engine.hpp"
+#include "bench_util.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+/*
+Volume read benchmark: point lookups through get_volume_at_level, the
+cumulative depth queries and queue_position (built with QPOS=1), against a
+book with a few thousand resting orders spread around a mid price.
+*/
+
+static constexpr std::size_t BATCH = 256;
+static constexpr std::size_t SAMPLES = 4096;
+static constexpr PriceType MID = 4096;
+
+static void populate(Orderbook &ob, std::mt19937 &rng) {
+    std::uniform_int_distribution<int> offset(1, 400);
+    std::uniform_int_distribution<int> qty(1, 100);
+    for (IdType id = 0; id < 8000; ++id) {
+        const Side side = id & 1 ? Side::SELL : Side::BUY;
+        const int off = offset(rng);
+        const PriceType price =
+            side == Side::BUY ? MID - off : MID + off;
+        match_order(ob, Order{id, price, static_cast<QuantityType>(qty(rng)),
+                              side});
+    }
+}
+
+template <typename Fn>
+static void run(const char *name, const std::vector<PriceType> &prices,
+                const std::vector<Side> &sides, Fn &&fn) {
+    std::vector<uint64_t> samples;
+    samples.reserve(SAMPLES);
+    std::size_t k = 0;
+    for (std::size_t s = 0; s < SAMPLES; ++s) {
+        uint64_t sink = 0;
+        const uint64_t t0 = tsc_start();
+        for (std::size_t i = 0; i < BATCH; ++i, ++k) {
+            const std::size_t j = k % prices.size();
+            sink += fn(sides[j], prices[j]);
+        }
+        const uint64_t t1 = tsc_stop();
+        do_not_optimize(sink);
+        samples.push_back(t1 - t0);
+    }
+    print_stats(name, summarise(std::move(samples), BATCH));
+}
+
+int main() {
+    std::mt19937 rng(42);
+    Orderbook *ob = create_orderbook();
+    populate(*ob, rng);
+
+    std::vector<PriceType> prices(1 << 14);
+    std::vector<Side> sides(prices.size());
+    std::uniform_int_distribution<int> offset(0, 400);
+    for (std::size_t i = 0; i < prices.size(); ++i) {
+        sides[i] = rng() & 1 ? Side::SELL : Side::BUY;
+        prices[i] = sides[i] == Side::BUY ? MID - offset(rng)
+                                          : MID + offset(rng);
+    }
+
+    run("get_volume_at_level", prices, sides, [&](Side side, PriceType p) {
+        return get_volume_at_level(*ob, side, p);
+    });
+    run("get_volume_up_to_price", prices, sides, [&](Side side, PriceType p) {
+        return get_volume_up_to_price(*ob, side, p);
+    });
+    run("get_volume_within_ticks(16)", prices, sides,
+        [&](Side side, PriceType) {
+            return get_volume_within_ticks(*ob, side, 16);
+        });
+    run("get_volume_within_ticks(256)", prices, sides,
+        [&](Side side, PriceType) {
+            return get_volume_within_ticks(*ob, side, 256);
+        });
+    run("get_price_for_quantity", prices, sides, [&](Side side, PriceType p) {
+        PriceType worst = 0;
+        get_price_for_quantity(*ob, side, p * 10u, worst);
+        return worst;
+    });
+
+#if ENGINE_QUEUE_POSITION
+    // Resting ids in place of prices; about a fifth of them cancelled so
+    // the queues carry adjusted entries
+    std::vector<PriceType> ids(prices.size());
+    for (std::size_t i = 0; i < ids.size(); ++i)
+        ids[i] = static_cast<PriceType>(rng() % 8000);
+    for (IdType id = 0; id < 8000; id += 5)
+        modify_order_by_id(*ob, id, 0);
+    run("queue_position", ids, sides, [&](Side, PriceType id) {
+        QueuePosition position{};
+        queue_position(*ob, id, position);
+        return position.volume_ahead;
+    });
+#endif
+
+    delete ob;
+    return 0;
+}
@@ -0,0 +1,149 @@
+#include "book_scheduler.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <new>
+
+namespace {
+
+// Per-thread free list of fixed-size coroutine frames, so steady-state
+// matching does not go through the allocator
+class FramePool {
+  private:
+    static constexpr std::size_t BLOCK_SIZE = 256;
+    struct Node {
+        Node *next;
+    };
+    Node *free_ = nullptr;
+
+  public:
+    ~FramePool() {
+        while (free_) {
+            Node *next = free_->next;
+            ::operator delete(free_);
+            free_ = next;
+        }
+    }
+
+    void *allocate(std::size_t size) {
+        if (size > BLOCK_SIZE) [[unlikely]]
+            return ::operator new(size);
+        if (!free_) [[unlikely]]
+            return ::operator new(BLOCK_SIZE);
+        Node *node = free_;
+        free_ = node->next;
+        return node;
+    }
+
+    void release(void *ptr, std::size_t size) noexcept {
+        if (size > BLOCK_SIZE) [[unlikely]] {
+            ::operator delete(ptr);
+            return;
+        }
+        free_ = new (ptr) Node{free_};
+    }
+};
+
+thread_local FramePool frame_pool;
+
+struct MatchTask {
+    struct promise_type {
+        MatchTask get_return_object() noexcept {
+            return {std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        // Runs up to the first prefetch straight away
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        // Left suspended so the matcher can see done() and destroy it
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        static void *operator new(std::size_t size) {
+            return frame_pool.allocate(size);
+        }
+        static void operator delete(void *ptr, std::size_t size) noexcept {
+            frame_pool.release(ptr, size);
+        }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+// One match_order, split into prefetch stages. Another request may have
+// changed the same book while this one was suspended, so each stage re-reads
+// what it needs rather than carrying state over; a stale guess only costs a
+// useless prefetch. The number of suspensions must not depend on the data
+// (see the ordering note in book_scheduler.hpp).
+MatchTask staged_match(Orderbook &book, Order order, uint32_t &result) {
+    const bool isSell = static_cast<bool>(order.side);
+    OBSide &x_levels = book._levels[!isSell];
+    const OBSide &s_levels = book._levels[isSell];
+
+    // Ladder sizes, and the lines touched if the order rests
+    x_levels.prefetch_ladder();
+    s_levels.prefetch_ladder();
+    s_levels.prefetch_level(order.price - BASE_PRICE);
+    __builtin_prefetch(&book._order_quantities[order.id], 1);
+    co_await std::suspend_always{};
+
+    x_levels.prefetch_best();
+    co_await std::suspend_always{};
+
+    if (!x_levels.empty())
+        x_levels.prefetch_level(x_levels.best_price());
+    co_await std::suspend_always{};
+
+    if (!x_levels.empty())
+        x_levels.prefetch_level_front(x_levels.best_price());
+    co_await std::suspend_always{};
+
+    if (!x_levels.empty()) {
+        auto [orders_at_level, best_price] = x_levels.get_best_nonempty();
+        if (!orders_at_level.empty()) {
+            const IdType id = orders_at_level.front();
+            __builtin_prefetch(&book._order_quantities[id], 1);
+            __builtin_prefetch(&book._order_infos[id]);
+        }
+    }
+    co_await std::suspend_always{};
+
+    result = match_order(book, order);
+}
+
+} // namespace
+
+InterleavedMatcher::InterleavedMatcher(uint32_t in_flight) noexcept
+    : in_flight_(std::clamp<uint32_t>(in_flight, 1, MAX_IN_FLIGHT)) {}
+
+void InterleavedMatcher::run(const MatchRequest *requests, std::size_t count,
+                             uint32_t *results) noexcept {
+    std::coroutine_handle<> slots[MAX_IN_FLIGHT] = {};
+    std::size_t next = 0;
+    uint32_t active = 0;
+
+    // Round-robin over the slots. A slot whose request finished is refilled
+    // in the same pass, so slot order within a pass is submission order.
+    while (next < count || active) {
+        for (uint32_t i = 0; i < in_flight_; ++i) {
+            std::coroutine_handle<> &slot = slots[i];
+            if (slot) {
+                slot.resume();
+                if (slot.done()) {
+                    slot.destroy();
+                    slot = nullptr;
+                    --active;
+                }
+            }
+            if (!slot && next < count) {
+                slot = staged_match(*requests[next].book,
+                                    requests[next].order, results[next])
+                           .handle;
+                ++next;
+                ++active;
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "engine.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+Interleaved matching across many books on one core.
+
+When a core serves more books than fit in cache, each match_order stalls on
+a chain of dependent misses into a different book: price ladder size ->
+ladder tail -> level queue indices -> queue front -> counter order. The
+matcher runs up to `in_flight` requests as C++20 coroutines. Each one
+prefetches the next link of its chain and suspends, and the matcher resumes
+the others in the meantime (AMAC-style), so the misses of different requests
+overlap instead of serialising.
+
+Every request goes through the same fixed number of stages and is resumed
+round-robin, so requests complete, and therefore call match_order, in
+submission order. Results are identical to calling match_order sequentially,
+including when several requests target the same book.
+*/
+
+struct MatchRequest {
+    Orderbook *book;
+    Order order;
+};
+
+class InterleavedMatcher {
+  public:
+    static constexpr uint32_t MAX_IN_FLIGHT = 32;
+
+    explicit InterleavedMatcher(uint32_t in_flight = 8) noexcept;
+
+    // Matches requests[0, count) and stores each match_order result in
+    // results[i]
+    void run(const MatchRequest *requests, std::size_t count,
+             uint32_t *results) noexcept;
+
+  private:
+    uint32_t in_flight_;
+};
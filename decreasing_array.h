@@ -19,6 +19,15 @@ template <typename T, std::size_t Size> class DecreasingSortedArray {
     inline __attribute__((always_inline, hot)) const T &back() const {
         return data[count - 1];
     }
+
+    const T &operator[](std::size_t i) const { return data[i]; }
+
+    // Cache hints: the element count sits past the data, so warming back()
+    // from cold takes two dependent steps
+    inline void prefetch_size() const { __builtin_prefetch(&count); }
+    inline void prefetch_back() const {
+        __builtin_prefetch(&data[count ? count - 1 : 0]);
+    }
     // Remove the last element (smallest value)
     inline __attribute__((always_inline, hot)) void pop_back() {
         if (empty()) {
@@ -1,71 +1,273 @@
 #include "engine.hpp"
+#include "flight_recorder.hpp"
 
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <new>
 #include <stdexcept>
 
-// This is an example correct implementation
-// It is INTENTIONALLY suboptimal
-// You are encouraged to rewrite as much or as little as you'd like
-inline __attribute__((always_inline, hot)) uint32_t process_orders(
-    Order &order, OBSide &x_levels, OBSide &s_levels, Volumes &volumes,
-    OrderStore &orders, OrderBitSet &_orders_active) noexcept {
+// The layout every unit including engine.hpp links against
+extern "C" const int ENGINE_LAYOUT_SYMBOL(ENGINE_LAYOUT) = sizeof(Orderbook);
+
+// Resting orders of `side` live in that side's OBSide
+static inline __attribute__((always_inline)) OBSide &
+side_levels(Orderbook &orderbook, Side side) noexcept {
+    return orderbook._levels[static_cast<size_t>(side)];
+}
+
+// Prefetches the quantity slot of the order queued `ahead` places behind the
+// front, and its info (owner) slot if the fill will read it, so their
+// (random) loads are in flight before the order reaches the front.
+template <typename Queue>
+static inline __attribute__((always_inline, hot)) void
+prefetch_queued(const Queue &queue, const OrderQuantities &quantities,
+                const OrderInfos &infos, uint32_t ahead,
+                bool owners) noexcept {
+    if constexpr (PREFETCH_DISTANCE > 0) {
+        const IdType id = queue.peek(ahead);
+        __builtin_prefetch(&quantities[id], 1, 3);
+        if (owners)
+            __builtin_prefetch(&infos[id], 0, 3);
+    }
+}
+
+// Signed position change for `quantity` filled on `side` (BUY positive)
+static inline __attribute__((always_inline)) int32_t
+signed_quantity(QuantityType quantity, Side side) noexcept {
+    return side == Side::BUY ? quantity : -static_cast<int32_t>(quantity);
+}
+
+// Pre-trade checks for `order` against its participant's limits. The
+// outcomes are OR'd together so an accepted order costs one branch.
+// Without OrderLimits the caller has already checked quantity and notional.
+template <bool OrderLimits>
+static inline __attribute__((always_inline, hot)) bool
+risk_accepts(const Order &order, const RiskState &risk,
+             const OBSide &x_levels) noexcept {
+    const int32_t position =
+        risk.position + signed_quantity(order.quantity, order.side);
+
+    bool breach = std::abs(position) > risk.max_position;
+    if constexpr (OrderLimits) {
+        const uint32_t notional =
+            static_cast<uint32_t>(order.price) * order.quantity;
+        breach |= order.quantity > risk.max_order_quantity;
+        breach |= notional > risk.max_order_notional;
+    }
+    // Anchored at the best level with volume: the ladder's back may only
+    // hold lazily cancelled entries
+    PriceType best;
+    if (x_levels.live_best_price(best))
+        breach |= std::abs(static_cast<int32_t>(order.price) -
+                           static_cast<int32_t>(best + BASE_PRICE)) >
+                  risk.price_band;
+    return !breach;
+}
+
+// Adds what is left of `order` to its own side of the book. A non-zero
+// `display` shows at most that much and holds the rest in reserve. If the
+// level's queue is full the remainder is dropped, nothing rests and the drop
+// is counted in _dropped_rests.
+static inline __attribute__((always_inline, hot)) void
+rest_order(Orderbook &orderbook, Order &order, OBSide &s_levels,
+           ParticipantType participant, QuantityType display) noexcept {
+    QuantityType reserve = 0;
+    if (display && order.quantity > display) [[unlikely]] {
+        reserve = order.quantity - display;
+        order.quantity = display;
+    }
+
+    // Level header (queue + volume), queue block and depth block, plus the
+    // level's priority header with queue positions on; the ladder only on
+    // level creation
+    QueueStamp stamp;
+    if (!s_levels.add_order(order, stamp)) [[unlikely]] {
+        ++orderbook._dropped_rests;
+        return;
+    }
+    // One line each in the two order arrays
+    orderbook._order_quantities[order.id] = order.quantity;
+    orderbook._order_infos[order.id] = {order.price, order.side, participant,
+                                        stamp};
+    if (orderbook._self_trade_participants) [[unlikely]]
+        ++orderbook
+              ._resting_counts[participant][static_cast<size_t>(order.side)];
+
+    if (reserve) [[unlikely]] {
+        orderbook._order_reserves[order.id] = reserve;
+        orderbook._order_displays[order.id] = display;
+        s_levels.adjust_reserve(order.price - BASE_PRICE, reserve);
+        ++orderbook._iceberg_counts[static_cast<size_t>(order.side)];
+    }
+}
+
+// Refills a filled iceberg order (already popped from the front of `queue`)
+// from its reserve and re-queues it at the back, behind everything resting
+// at the level. Returns false, leaving the order filled, if it had no
+// reserve left.
+static inline bool replenish_iceberg(Orderbook &orderbook, OBSide &levels,
+                                     size_t side,
+                                     OBSide::OrdQueue queue, PriceType level,
+                                     IdType id) noexcept {
+    QuantityType &reserve = orderbook._order_reserves[id];
+    if (!reserve)
+        return false;
+
+    const QuantityType refill =
+        std::min(reserve, orderbook._order_displays[id]);
+    reserve -= refill;
+    if (!reserve)
+        --orderbook._iceberg_counts[side];
+    orderbook._order_quantities[id] = refill;
+    levels.adjust_volume(level, refill);
+    levels.adjust_reserve(level, -static_cast<VolumeType>(refill));
+    queue.push_back(id); // the pop just made room
+    orderbook._order_infos[id].stamp = levels.stamp_back(level, queue, refill);
+    return true;
+}
+
+// Drops whatever an iceberg still holds in reserve
+static inline void cancel_reserve(Orderbook &orderbook, OBSide &levels,
+                                  size_t side, PriceType level,
+                                  IdType id) noexcept {
+    QuantityType &reserve = orderbook._order_reserves[id];
+    if (!reserve)
+        return;
+    levels.adjust_reserve(level, -static_cast<VolumeType>(reserve));
+    reserve = 0;
+    --orderbook._iceberg_counts[side];
+}
+
+// Matches `order` against the opposite side and rests what is left.
+//
+// SelfTradeCheck instantiates the self-trade handling into the loop. It is
+// only used when the incoming order's participant actually has orders
+// resting on the other side, so the common instantiation carries no owner
+// compare at all.
+template <bool SelfTradeCheck>
+inline __attribute__((always_inline, hot)) uint32_t
+process_orders(Orderbook &orderbook, Order &order, OBSide &x_levels,
+               OBSide &s_levels, ParticipantType participant,
+               QuantityType display, MatchTrace &trace) noexcept {
+    OrderQuantities &quantities = orderbook._order_quantities;
+    OrderInfos &infos = orderbook._order_infos;
+    RiskTable &risk = orderbook._risk;
+    const size_t x_side = !static_cast<size_t>(order.side);
+    // Filled counter orders only need a reserve lookup if some resting
+    // order on that side is an iceberg
+    const bool x_icebergs = orderbook._iceberg_counts[x_side] != 0;
+    // Fills only read the counter order's owner for the per-owner resting
+    // counts (kept while anyone has self-trade prevention on) and risk
+    const bool track_owners = orderbook._self_trade_participants != 0;
+    const bool owners = track_owners || RISK_CHECKS;
 
     uint32_t match_count = 0;
+    QuantityType filled = 0;
 
     while (order.quantity > 0) {
         if (!x_levels.can_fill(order)) [[unlikely]]
             break;
 
         auto [orders_at_level, best_price] = x_levels.get_best_nonempty();
-
-        VolumeType &vol_at_level =
-            volumes[best_price][!static_cast<size_t>(order.side)];
+        ++trace.levels_crossed;
 
         // Trim cancelled orders at the front (keeps the match loop
         // branch-light).
-        while (!orders_at_level->empty()) {
-            const IdType id = orders_at_level->front();
-            if (_orders_active[id]) [[likely]]
+        while (!orders_at_level.empty()) {
+            const IdType id = orders_at_level.front();
+            if (quantities[id]) [[likely]]
                 break;
-            orders_at_level->pop_front();
+            orders_at_level.pop_front();
+            ++trace.trimmed;
         }
 
-        if (orders_at_level->empty()) [[unlikely]]{ 
+        if (orders_at_level.empty()) [[unlikely]]{ 
             x_levels.remove_best();
             continue;
         }
 
-        // Match against active front orders.
-        while (order.quantity > 0 && !orders_at_level->empty()) {
-            const IdType counter_order_id = orders_at_level->front();
-            auto &counter_order = orders[counter_order_id];
+        // Start the look-ahead window over the level's queue
+        for (uint32_t ahead = 1; ahead <= PREFETCH_DISTANCE; ++ahead)
+            prefetch_queued(orders_at_level, quantities, infos, ahead,
+                            owners);
 
-            const QuantityType trade =
-                std::min(order.quantity, counter_order.quantity);
+        // Match against active front orders. Volume is settled once per
+        // level rather than per trade.
+        VolumeType traded = 0;
+        while (order.quantity > 0 && !orders_at_level.empty()) {
+            const IdType counter_order_id = orders_at_level.front();
+            QuantityType &counter_quantity = quantities[counter_order_id];
 
-            order.quantity -= trade;
-            counter_order.quantity -= trade;
-            vol_at_level -= trade;
+            bool self_trade = false;
+            if constexpr (SelfTradeCheck)
+                self_trade = infos[counter_order_id].owner == participant;
 
-            ++match_count;
+            if (self_trade) [[unlikely]] {
+                // Nothing trades; the configured side(s) are cancelled or
+                // reduced instead
+                switch (orderbook._self_trade_modes[participant]) {
+                case SelfTradeMode::CANCEL_AGGRESSOR:
+                    order.quantity = 0;
+                    continue;
+                case SelfTradeMode::CANCEL_RESTING:
+                    cancel_reserve(orderbook, x_levels, x_side, best_price,
+                                   counter_order_id);
+                    traded += counter_quantity;
+                    counter_quantity = 0;
+                    break;
+                default: { // DECREMENT_BOTH
+                    const QuantityType reduce =
+                        std::min(order.quantity, counter_quantity);
+                    order.quantity -= reduce;
+                    counter_quantity -= reduce;
+                    traded += reduce;
+                    break;
+                }
+                }
+            } else {
+                const QuantityType trade =
+                    std::min(order.quantity, counter_quantity);
+
+                order.quantity -= trade;
+                counter_quantity -= trade;
+                traded += trade;
+                filled += trade;
+
+                if constexpr (RISK_CHECKS)
+                    risk[infos[counter_order_id].owner].position -=
+                        signed_quantity(trade, order.side);
 
-            // After a trade, at least one side is fully consumed.
-            if (counter_order.quantity == 0) {
-                _orders_active.reset(counter_order_id);
-                orders_at_level->pop_front();
+                ++match_count;
+            }
+
+            // After a trade, at least one side is fully consumed. A zero
+            // quantity already marks the counter order inactive.
+            if (counter_quantity == 0) {
+                orders_at_level.pop_front();
+                const bool replenished =
+                    x_icebergs && replenish_iceberg(orderbook, x_levels,
+                                                    x_side, orders_at_level,
+                                                    best_price,
+                                                    counter_order_id);
+                if (track_owners && !replenished) [[unlikely]]
+                    --orderbook
+                          ._resting_counts[infos[counter_order_id].owner]
+                                          [x_side];
+                prefetch_queued(orders_at_level, quantities, infos,
+                                PREFETCH_DISTANCE, owners);
 
                 // Trim again: next front may be a cancelled order.
-                while (!orders_at_level->empty()) {
-                    const IdType id = orders_at_level->front();
-                    if (_orders_active[id]) [[likely]]
+                while (!orders_at_level.empty()) {
+                    const IdType id = orders_at_level.front();
+                    if (quantities[id]) [[likely]]
                         break;
-                    orders_at_level->pop_front();
+                    orders_at_level.pop_front();
+                    ++trace.trimmed;
                 }
 
-                if (orders_at_level->empty()) [[unlikely]] {
+                if (orders_at_level.empty()) [[unlikely]] {
                     x_levels.remove_best();
                     break;
                 }
@@ -73,64 +275,601 @@ inline __attribute__((always_inline, hot)) uint32_t process_orders(
 			// If the resting order wasn't depleted, the incoming order must
 			// be.
         }
+        x_levels.adjust_volume(best_price, -traded);
+        trace.queue_depth = orders_at_level.size();
     }
 
+    if constexpr (RISK_CHECKS)
+        risk[participant].position += signed_quantity(filled, order.side);
+
     if (order.quantity > 0) {
-        s_levels.add_order(order);
-        volumes[order.price - BASE_PRICE][static_cast<size_t>(order.side)] +=
-            order.quantity;
-        _orders_active.set(order.id);
-        orders[order.id] = order;
+        rest_order(orderbook, order, s_levels, participant, display);
+        trace.queue_depth = s_levels.depth_at(order.price - BASE_PRICE);
     }
 
     return match_count;
 };
 
-[[nodiscard]] uint32_t match_order(Orderbook &orderbook, const Order &incoming) noexcept  {
+template <bool OrderLimits>
+static inline __attribute__((always_inline, hot)) uint32_t
+match_order_impl(Orderbook &orderbook, const Order &incoming,
+                 ParticipantType participant, QuantityType display) noexcept {
+    const uint64_t entry = flight_clock();
+    MatchTrace trace;
     uint32_t match_count = 0;
     Order order = incoming;
     const bool isSell = static_cast<bool>(order.side);
+    OBSide &x_levels = orderbook._levels[!isSell];
+    OBSide &s_levels = orderbook._levels[isSell];
 
-    match_count = process_orders(
-        order, isSell ? orderbook._buy_levels : orderbook._sell_levels,
-        isSell ? orderbook._sell_levels : orderbook._buy_levels,
-        orderbook._volumes, orderbook._orders, orderbook._orders_active);
+    if constexpr (RISK_CHECKS) {
+        const RiskState &risk = orderbook._risk[participant];
+        if (!risk_accepts<OrderLimits>(order, risk, x_levels)) [[unlikely]] {
+            flight_record(FlightOp::MATCH, entry, incoming, participant,
+                          RISK_REJECTED, trace);
+            return RISK_REJECTED;
+        }
+    }
+
+    // Auctions only accumulate; uncross() does the matching
+    if (orderbook._in_auction) [[unlikely]] {
+        rest_order(orderbook, order, s_levels, participant, display);
+        trace.queue_depth = s_levels.depth_at(order.price - BASE_PRICE);
+        flight_record(FlightOp::MATCH, entry, incoming, participant, 0, trace);
+        return 0;
+    }
 
+    // Self-trade handling only when this participant could actually hit
+    // one of its own orders. Slot 0 (plain match_order) is never checked.
+    const bool self_trade_possible =
+        participant != 0 &&
+        orderbook._self_trade_modes[participant] != SelfTradeMode::NONE &&
+        orderbook._resting_counts[participant][!isSell] != 0;
+
+    if (self_trade_possible) [[unlikely]]
+        match_count = process_orders<true>(orderbook, order, x_levels,
+                                           s_levels, participant, display,
+                                           trace);
+    else
+        match_count = process_orders<false>(orderbook, order, x_levels,
+                                            s_levels, participant, display,
+                                            trace);
+
+    flight_record(FlightOp::MATCH, entry, incoming, participant, match_count,
+                  trace);
     return match_count;
 }
 
+[[nodiscard]] uint32_t match_order_as(Orderbook &orderbook,
+                                      const Order &incoming,
+                                      ParticipantType participant) noexcept {
+    return match_order_impl<true>(orderbook, incoming, participant, 0);
+}
+
+uint32_t match_iceberg_as(Orderbook &orderbook, const Order &incoming,
+                          QuantityType display_quantity,
+                          ParticipantType participant) noexcept {
+    return match_order_impl<true>(orderbook, incoming, participant,
+                                  display_quantity);
+}
+
+uint32_t engine_detail::match_prechecked(Orderbook &orderbook,
+                                         const Order &incoming,
+                                         QuantityType display_quantity,
+                                         ParticipantType participant) noexcept {
+    return match_order_impl<false>(orderbook, incoming, participant,
+                                   display_quantity);
+}
+
+[[nodiscard]] uint32_t match_order(Orderbook &orderbook,
+                                   const Order &incoming) noexcept {
+    return match_order_as(orderbook, incoming, 0);
+}
+
 void modify_order_by_id(Orderbook &orderbook, IdType order_id,
                         QuantityType new_quantity) noexcept {
-    if (!orderbook._orders_active[order_id]) [[unlikely]] {
+    const uint64_t entry = flight_clock();
+    MatchTrace trace;
+    QuantityType &quantity = orderbook._order_quantities[order_id];
+    if (!quantity) [[unlikely]] {
+        flight_record(FlightOp::MODIFY, entry,
+                      Order{order_id, 0, new_quantity, Side::BUY}, 0, 0,
+                      trace);
         return;
     }
 
-    auto &order = orderbook._orders[order_id];
-    orderbook._volumes[order.price][static_cast<uint8_t>(order.side)] +=
-        (new_quantity - order.quantity);
+    const OrderInfo &info = orderbook._order_infos[order_id];
+    OBSide &levels = side_levels(orderbook, info.side);
+    levels.adjust_volume(info.price - BASE_PRICE, new_quantity - quantity);
+    levels.note_modify(info.price - BASE_PRICE, info.stamp, quantity,
+                       new_quantity);
+
+    // new_quantity == 0 doubles as the cancel; the stale queue entry is
+    // trimmed lazily by the match loop
+    if (new_quantity == 0) {
+        const size_t side = static_cast<size_t>(info.side);
+        if (orderbook._self_trade_participants) [[unlikely]]
+            --orderbook._resting_counts[info.owner][side];
+        cancel_reserve(orderbook, levels, side, info.price - BASE_PRICE,
+                       order_id);
+    }
+    quantity = new_quantity;
+
+    trace.queue_depth = levels.depth_at(info.price - BASE_PRICE);
+    flight_record(FlightOp::MODIFY, entry,
+                  Order{order_id, info.price, new_quantity, info.side},
+                  info.owner, 0, trace);
+}
+
+void set_self_trade_mode(Orderbook &orderbook, ParticipantType participant,
+                         SelfTradeMode mode) noexcept {
+    SelfTradeMode &current = orderbook._self_trade_modes[participant];
+    const bool was_set = current != SelfTradeMode::NONE;
+    const bool set = mode != SelfTradeMode::NONE;
+    current = mode;
+    if (was_set == set || participant == 0)
+        return;
+
+    if (set && orderbook._self_trade_participants++ == 0) {
+        // Counts were not kept while nobody used them; recount the book
+        orderbook._resting_counts = {};
+        for (IdType id = 0; id < MAX_ORDERS; ++id) {
+            if (!orderbook._order_quantities[id])
+                continue;
+            const OrderInfo &info = orderbook._order_infos[id];
+            ++orderbook._resting_counts[info.owner]
+                                       [static_cast<size_t>(info.side)];
+        }
+    } else if (!set) {
+        --orderbook._self_trade_participants;
+    }
+}
+
+void set_risk_limits(Orderbook &orderbook, ParticipantType participant,
+                     const RiskLimits &limits) noexcept {
+    orderbook._risk[participant].configure(limits);
+}
 
-    if (new_quantity == 0) [[likely]] {
-        orderbook._orders_active.reset(order_id);
-    } else [[unlikely]]
-        order.quantity = new_quantity; // Update quantity in orders array
+int32_t get_position(Orderbook &orderbook,
+                     ParticipantType participant) noexcept {
+    return orderbook._risk[participant].position;
 }
 
 uint32_t get_volume_at_level(Orderbook &orderbook, Side side,
                              PriceType price) noexcept {
-    return orderbook._volumes[price][static_cast<uint8_t>(side)];
+    return side_levels(orderbook, side).volume_at(price - BASE_PRICE);
+}
+
+uint32_t get_total_volume_at_level(Orderbook &orderbook, Side side,
+                                   PriceType price) noexcept {
+    const OBSide &levels = side_levels(orderbook, side);
+    return levels.volume_at(price - BASE_PRICE) +
+           levels.reserve_at(price - BASE_PRICE);
+}
+
+// Plain contiguous sum over [lo, hi) of a per-level or per-block array
+static inline VolumeType sum_volumes(const VolumeType *volumes, size_t lo,
+                                     size_t hi) noexcept {
+    VolumeType total = 0;
+    for (size_t i = lo; i < hi; ++i)
+        total += volumes[i];
+    return total;
+}
+
+// Sum of level volumes over [lo, hi), read from the level headers. Used
+// directly for short ranges and for the partial blocks at either end of a
+// long one.
+static inline VolumeType sum_level_volumes(const OBSide &levels, size_t lo,
+                                           size_t hi) noexcept {
+    VolumeType total = 0;
+    for (size_t i = lo; i < hi; ++i)
+        total += levels.volume_at(i);
+    return total;
+}
+
+// Sum of one side's volume over levels [lo, hi) using the block index for
+// every fully covered block.
+static VolumeType sum_volume_range(const OBSide &levels, size_t lo,
+                                   size_t hi) noexcept {
+    const size_t first_block = (lo + VOLUME_BLOCK_SIZE - 1) / VOLUME_BLOCK_SIZE;
+    const size_t last_block = hi / VOLUME_BLOCK_SIZE;
+    if (first_block >= last_block)
+        return sum_level_volumes(levels, lo, hi);
+
+    VolumeType total =
+        sum_level_volumes(levels, lo, first_block * VOLUME_BLOCK_SIZE);
+    total +=
+        sum_volumes(levels.volume_blocks().data(), first_block, last_block);
+    total += sum_level_volumes(levels, last_block * VOLUME_BLOCK_SIZE, hi);
+    return total;
+}
+
+uint32_t get_volume_up_to_price(Orderbook &orderbook, Side side,
+                                PriceType price) noexcept {
+    const size_t level = price - BASE_PRICE;
+    if (side == Side::BUY)
+        return sum_volume_range(side_levels(orderbook, side), level,
+                                MAX_NUM_PRICES);
+    return sum_volume_range(side_levels(orderbook, side), 0,
+                            std::min<size_t>(level + 1, MAX_NUM_PRICES));
+}
+
+uint32_t get_volume_within_ticks(Orderbook &orderbook, Side side,
+                                 PriceType ticks) noexcept {
+    const OBSide &levels = side_levels(orderbook, side);
+    PriceType live_best;
+    if (!levels.live_best_price(live_best))
+        return 0;
+
+    const size_t best = live_best;
+    if (side == Side::BUY)
+        return sum_volume_range(levels, best > ticks ? best - ticks : 0,
+                                best + 1);
+    return sum_volume_range(levels, best,
+                            std::min<size_t>(best + ticks + 1, MAX_NUM_PRICES));
+}
+
+// Walks levels away from the best price (downwards for BUY, upwards for SELL)
+// until `quantity` is covered, skipping whole blocks that do not cover it.
+template <bool Ascending>
+static bool walk_for_quantity(const OBSide &levels, uint32_t quantity,
+                              size_t &worst) noexcept {
+    constexpr ptrdiff_t step = Ascending ? 1 : -1;
+    const VolumeBlocks &blocks = levels.volume_blocks();
+
+    // Levels left in the best price's own block
+    ptrdiff_t i = static_cast<ptrdiff_t>(levels.best_price());
+    const ptrdiff_t block_end =
+        Ascending ? (i / VOLUME_BLOCK_SIZE + 1) * VOLUME_BLOCK_SIZE
+                  : (i / VOLUME_BLOCK_SIZE) * VOLUME_BLOCK_SIZE - 1;
+    for (; i != block_end; i += step) {
+        if (levels.volume_at(i) >= quantity) {
+            worst = i;
+            return true;
+        }
+        quantity -= levels.volume_at(i);
+    }
+
+    // Whole blocks
+    ptrdiff_t b = Ascending ? block_end / VOLUME_BLOCK_SIZE
+                            : (block_end + 1) / VOLUME_BLOCK_SIZE - 1;
+    for (; b >= 0 && b < NUM_VOLUME_BLOCKS; b += step) {
+        if (blocks[b] >= quantity)
+            break;
+        quantity -= blocks[b];
+    }
+    if (b < 0 || b >= NUM_VOLUME_BLOCKS)
+        return false;
+
+    // Level within the block that covers the remainder
+    for (i = Ascending ? b * VOLUME_BLOCK_SIZE
+                       : (b + 1) * VOLUME_BLOCK_SIZE - 1;;
+         i += step) {
+        if (levels.volume_at(i) >= quantity) {
+            worst = i;
+            return true;
+        }
+        quantity -= levels.volume_at(i);
+    }
+}
+
+bool get_price_for_quantity(Orderbook &orderbook, Side side, uint32_t quantity,
+                            PriceType &worst_price) noexcept {
+    const OBSide &levels = side_levels(orderbook, side);
+    if (levels.empty())
+        return false;
+
+    size_t worst;
+    const bool filled =
+        side == Side::BUY ? walk_for_quantity<false>(levels, quantity, worst)
+                          : walk_for_quantity<true>(levels, quantity, worst);
+    if (filled)
+        worst_price = static_cast<PriceType>(worst + BASE_PRICE);
+    return filled;
+}
+
+void begin_auction(Orderbook &orderbook) noexcept {
+    orderbook._in_auction = true;
+}
+
+// Levels the equilibrium search skips at a time before narrowing to single
+// volume blocks
+static constexpr size_t EQUILIBRIUM_RUN_SIZE = 8 * VOLUME_BLOCK_SIZE;
+
+// Ranks an uncross price by executed volume, then by smallest imbalance, so
+// the best price has the largest key
+static inline uint64_t equilibrium_key(uint64_t demand,
+                                       uint64_t supply) noexcept {
+    const uint64_t executed = std::min(demand, supply);
+    const uint64_t imbalance =
+        demand > supply ? demand - supply : supply - demand;
+    return executed << 32 | (UINT32_MAX - imbalance);
+}
+
+bool get_equilibrium(Orderbook &orderbook, PriceType &price,
+                     uint32_t &volume) noexcept {
+    const OBSide &buys = side_levels(orderbook, Side::BUY);
+    const OBSide &sells = side_levels(orderbook, Side::SELL);
+    if (buys.empty() || sells.empty())
+        return false;
+
+    // Only levels in [best ask, best bid] can trade, and within that range
+    // buy demand at p is all buy volume at >= p and sell supply all sell
+    // volume at <= p.
+    const size_t lo = sells.best_price();
+    const size_t hi = buys.best_price();
+    if (lo > hi)
+        return false;
+
+    // Iceberg reserves take part in the uncross
+    const Volumes &buy_reserves = buys.reserve_volumes();
+    const Volumes &sell_reserves = sells.reserve_volumes();
+    const auto buy_at = [&](size_t p) -> uint64_t {
+        return buys.volume_at(p) + buy_reserves[p];
+    };
+    const auto sell_at = [&](size_t p) -> uint64_t {
+        return sells.volume_at(p) + sell_reserves[p];
+    };
+    const auto range_total = [](const OBSide &levels, const Volumes &reserves,
+                                size_t from, size_t to) -> uint64_t {
+        return sum_volume_range(levels, from, to) +
+               sum_volumes(reserves.data(), from, to);
+    };
+
+    // Demand only falls and supply only rises with the price, so the key
+    // rises while supply < demand and falls from the first price where
+    // supply >= demand. The best price is that crossing or the one below
+    // it. Find the run of blocks holding the crossing from the block sums,
+    // then the block within it, then walk that block's levels.
+    uint64_t demand = range_total(buys, buy_reserves, lo, hi + 1);
+    uint64_t supply = 0;
+    size_t start = lo;
+    for (const size_t span :
+         {EQUILIBRIUM_RUN_SIZE, size_t{VOLUME_BLOCK_SIZE}}) {
+        for (;;) {
+            const size_t end = std::min(hi + 1, (start / span + 1) * span);
+            if (end == hi + 1)
+                break;
+            const uint64_t sold =
+                range_total(sells, sell_reserves, start, end);
+            const uint64_t bought =
+                range_total(buys, buy_reserves, start, end);
+            // Demand at the span's last level still includes that level
+            if (supply + sold >= demand - bought + buy_at(end - 1))
+                break;
+            supply += sold;
+            demand -= bought;
+            start = end;
+        }
+    }
+
+    // Supply and demand at p, walking from the block's first level
+    size_t p = start;
+    for (;;) {
+        supply += sell_at(p);
+        if (supply >= demand || p == hi)
+            break;
+        demand -= buy_at(p);
+        ++p;
+    }
+    uint64_t best_key = equilibrium_key(demand, supply);
+    if (p > lo) {
+        const uint64_t below =
+            equilibrium_key(demand + buy_at(p - 1), supply - sell_at(p));
+        if (below > best_key) {
+            best_key = below;
+            supply -= sell_at(p);
+            --p;
+            demand += buy_at(p);
+        }
+    }
+
+    // Lazy cancels can leave the best prices without volume
+    volume = static_cast<uint32_t>(best_key >> 32);
+    if (volume == 0)
+        return false;
+
+    // Ties are the run of levels around p with the same key
+    size_t first = p, last = p;
+    for (uint64_t d = demand, s = supply; first > lo; --first) {
+        s -= sell_at(first);
+        d += buy_at(first - 1);
+        if (equilibrium_key(d, s) != best_key)
+            break;
+    }
+    for (uint64_t d = demand, s = supply; last < hi; ++last) {
+        d -= buy_at(last);
+        s += sell_at(last + 1);
+        if (equilibrium_key(d, s) != best_key)
+            break;
+    }
+    price = static_cast<PriceType>((first + last) / 2 + BASE_PRICE);
+    return true;
+}
+
+// Front live order of the most competitive level on `levels`, dropping
+// cancelled orders and emptied levels on the way. The caller knows one
+// exists.
+static inline IdType auction_front(OBSide &levels,
+                                   const OrderQuantities &quantities,
+                                   PriceType &level) noexcept {
+    for (;;) {
+        auto [orders_at_level, best_price] = levels.get_best_nonempty();
+        while (!orders_at_level.empty() &&
+               !quantities[orders_at_level.front()])
+            orders_at_level.pop_front();
+        if (!orders_at_level.empty()) {
+            level = best_price;
+            return orders_at_level.front();
+        }
+        levels.remove_best();
+    }
+}
+
+// Bookkeeping for an order the uncross just filled. It is still the front
+// of the best level on `levels`.
+static inline void settle_auction_fill(Orderbook &orderbook, OBSide &levels,
+                                       size_t side, PriceType level,
+                                       IdType id) noexcept {
+    if (orderbook._order_reserves[id]) {
+        OBSide::OrdQueue queue = levels.get_best_nonempty().first;
+        queue.pop_front();
+        replenish_iceberg(orderbook, levels, side, queue, level, id);
+        return;
+    }
+    if (orderbook._self_trade_participants)
+        --orderbook._resting_counts[orderbook._order_infos[id].owner][side];
+}
+
+uint32_t uncross(Orderbook &orderbook) noexcept {
+    const uint64_t entry = flight_clock();
+    MatchTrace trace;
+    orderbook._in_auction = false;
+
+    PriceType price;
+    uint32_t volume;
+    if (!get_equilibrium(orderbook, price, volume)) {
+        flight_record(FlightOp::UNCROSS, entry, Order{0, 0, 0, Side::BUY}, 0,
+                      0, trace);
+        return 0;
+    }
+    const Order summary{0, price, flight_detail::saturate(volume), Side::BUY};
+
+    // Every buy at or above the price and every sell at or below it is
+    // eligible and at least one side is used up entirely, so pairing the
+    // fronts of both sides until `volume` is done executes exactly the
+    // eligible orders in price-time priority.
+    OBSide &buys = side_levels(orderbook, Side::BUY);
+    OBSide &sells = side_levels(orderbook, Side::SELL);
+    OrderQuantities &quantities = orderbook._order_quantities;
+    const OrderInfos &infos = orderbook._order_infos;
+
+    uint32_t match_count = 0;
+    while (volume > 0) {
+        PriceType buy_level, sell_level;
+        const IdType buy_id = auction_front(buys, quantities, buy_level);
+        const IdType sell_id = auction_front(sells, quantities, sell_level);
+
+        const QuantityType trade =
+            std::min(quantities[buy_id], quantities[sell_id]);
+        quantities[buy_id] -= trade;
+        quantities[sell_id] -= trade;
+        buys.adjust_volume(buy_level, -static_cast<VolumeType>(trade));
+        sells.adjust_volume(sell_level, -static_cast<VolumeType>(trade));
+        volume -= trade;
+        ++match_count;
+
+        if constexpr (RISK_CHECKS) {
+            orderbook._risk[infos[buy_id].owner].position += trade;
+            orderbook._risk[infos[sell_id].owner].position -= trade;
+        }
+
+        // Filled orders are left at the front for the next auction_front /
+        // match loop to trim, unless an iceberg replenishes
+        if (quantities[buy_id] == 0)
+            settle_auction_fill(orderbook, buys, 0, buy_level, buy_id);
+        if (quantities[sell_id] == 0)
+            settle_auction_fill(orderbook, sells, 1, sell_level, sell_id);
+    }
+
+    flight_record(FlightOp::UNCROSS, entry, summary, 0, match_count, trace);
+    return match_count;
+}
+
+bool order_id_queued(const Orderbook &orderbook, IdType order_id) noexcept {
+    if (orderbook._order_quantities[order_id])
+        return true;
+    // Cancels leave the price, side and queue slot of the last entry behind
+    const OrderInfo &info = orderbook._order_infos[order_id];
+    return orderbook._levels[static_cast<size_t>(info.side)].still_queued(
+        info.price - BASE_PRICE, info.stamp, order_id);
+}
+
+uint32_t get_dropped_rests(const Orderbook &orderbook) noexcept {
+    return orderbook._dropped_rests;
+}
+
+#if ENGINE_QUEUE_POSITION
+bool queue_position(Orderbook &orderbook, IdType order_id,
+                    QueuePosition &position) noexcept {
+    if (!orderbook._order_quantities[order_id])
+        return false;
+    const OrderInfo &info = orderbook._order_infos[order_id];
+    position = side_levels(orderbook, info.side)
+                   .position_of(info.price - BASE_PRICE, info.stamp,
+                                orderbook._order_quantities,
+                                orderbook._order_infos);
+    return true;
+}
+#endif
+
+bool flight_detail::create_records() noexcept {
+    // Frees the thread's records when the thread exits
+    struct Owner {
+        ~Owner() {
+            delete[] recorder.records;
+            recorder.records = nullptr;
+        }
+    };
+    static thread_local Owner owner;
+    recorder.records = new (std::nothrow) FlightRecord[FlightRecorder::CAPACITY];
+    return recorder.records != nullptr;
 }
 
 // Functions below here don't need to be performant. Just make sure they're
 // correct
 Order lookup_order_by_id(Orderbook &orderbook, IdType order_id) {
-    if (!orderbook._orders_active[order_id])
+    const QuantityType quantity = orderbook._order_quantities[order_id];
+    if (!quantity)
         throw std::runtime_error("Order not found");
 
-    return orderbook._orders[order_id];
+    const OrderInfo &info = orderbook._order_infos[order_id];
+    return {order_id, info.price, quantity, info.side};
 }
 
 bool order_exists(Orderbook &orderbook, IdType order_id) {
-    return orderbook._orders_active[order_id];
+    return orderbook._order_quantities[order_id] != 0;
 }
 
 Orderbook *create_orderbook() { return new Orderbook; }
+
+void set_flight_trigger(uint64_t threshold_cycles,
+                        FlightTrigger trigger) noexcept {
+    flight_detail::trigger.store(trigger, std::memory_order_release);
+    flight_detail::trigger_threshold.store(
+        trigger ? threshold_cycles : UINT64_MAX, std::memory_order_relaxed);
+}
+
+std::size_t flight_records(FlightRecord *out, std::size_t max) noexcept {
+    const FlightRecorder &recorder = flight_detail::recorder;
+    if (!recorder.records)
+        return 0;
+    const std::size_t count = std::min<uint64_t>(
+        {recorder.written, FlightRecorder::CAPACITY, max});
+    const uint64_t first = recorder.written - count;
+    for (std::size_t i = 0; i < count; ++i)
+        out[i] =
+            recorder.records[(first + i) & (FlightRecorder::CAPACITY - 1)];
+    return count;
+}
+
+void dump_flight_recorder(std::FILE *out) noexcept {
+    static constexpr const char *OP_NAMES[] = {"match", "modify", "uncross"};
+    const FlightRecorder &recorder = flight_detail::recorder;
+    if (!recorder.records)
+        return;
+    const uint64_t count =
+        std::min<uint64_t>(recorder.written, FlightRecorder::CAPACITY);
+    for (uint64_t i = recorder.written - count; i < recorder.written; ++i) {
+        const FlightRecord &r =
+            recorder.records[i & (FlightRecorder::CAPACITY - 1)];
+        std::fprintf(out,
+                     "%llu %-7s cycles %u id %u %s %u@%u participant %u "
+                     "matches %u levels %u trimmed %u depth %u\n",
+                     static_cast<unsigned long long>(r.entry),
+                     OP_NAMES[static_cast<size_t>(r.op)], r.cycles,
+                     r.order_id, r.side == Side::BUY ? "buy" : "sell",
+                     r.quantity, r.price, r.participant, r.matches,
+                     r.levels_crossed, r.trimmed, r.queue_depth);
+    }
+}
@@ -1,10 +1,10 @@
 #pragma once
 
-#include "circular_buffer.h"
 #include "decreasing_array.h"
+#include "level_queues.h"
 
 #include <array>
-#include <bitset>
+#include <bit>
 #include <cstdint>
 #include <cstdlib>
 #include <utility>
@@ -15,10 +15,76 @@ using IdType = uint32_t;
 using PriceType = uint16_t;
 using QuantityType = uint16_t;
 using VolumeType = uint32_t;
+using ParticipantType = uint8_t;
 
 static constexpr uint16_t MAX_ORDERS = 10'000;
-static constexpr uint16_t MAX_ORDERS_PER_LEVEL = 25;
+static constexpr uint16_t MAX_ORDERS_PER_LEVEL = 32;
 static constexpr uint16_t MAX_NUM_PRICES = 8192;
+static constexpr uint16_t MAX_PARTICIPANTS = 256;
+
+// Returned by match_order_as when the risk stage rejects an order
+static constexpr uint32_t RISK_REJECTED = UINT32_MAX;
+
+// Levels per block of the depth index: one cache line of level headers, so a
+// depth sum reads block sums plus at most one header line at either end
+static constexpr uint16_t VOLUME_BLOCK_SIZE = 8;
+static constexpr uint16_t NUM_VOLUME_BLOCKS =
+    MAX_NUM_PRICES / VOLUME_BLOCK_SIZE;
+
+// How many queued order ids ahead of the front the match loop prefetches.
+// Overridable so benchmarks can build a no-prefetch variant.
+#ifndef ENGINE_PREFETCH_DISTANCE
+#define ENGINE_PREFETCH_DISTANCE 4
+#endif
+static constexpr uint32_t PREFETCH_DISTANCE = ENGINE_PREFETCH_DISTANCE;
+static_assert(PREFETCH_DISTANCE < MAX_ORDERS_PER_LEVEL,
+              "queue look-ahead wraps at most once");
+
+// Pre-trade risk stage in match_order_as. Off by default: with 0 the checks
+// and the bookkeeping behind them compile away entirely.
+#ifndef ENGINE_RISK_CHECKS
+#define ENGINE_RISK_CHECKS 0
+#endif
+static constexpr bool RISK_CHECKS = ENGINE_RISK_CHECKS;
+
+// Per-thread flight recorder of recent ops (flight_recorder.hpp). On by
+// default: with 0 the recording compiles away.
+#ifndef ENGINE_FLIGHT_RECORDER
+#define ENGINE_FLIGHT_RECORDER 1
+#endif
+static constexpr bool FLIGHT_RECORDER = ENGINE_FLIGHT_RECORDER;
+// Ops per rdtsc read by the flight recorder, a power of two. 1 times every op.
+#ifndef ENGINE_FLIGHT_TIMING_INTERVAL
+#define ENGINE_FLIGHT_TIMING_INTERVAL 16
+#endif
+static constexpr uint32_t FLIGHT_TIMING_INTERVAL =
+    ENGINE_FLIGHT_TIMING_INTERVAL;
+static_assert(std::has_single_bit(FLIGHT_TIMING_INTERVAL),
+              "ENGINE_FLIGHT_TIMING_INTERVAL must be a power of two");
+
+// queue_position and the per-level counters behind it (144 bytes a level).
+// Off by default: with 0 a rest only stamps the order's ring slot.
+#ifndef ENGINE_QUEUE_POSITION
+#define ENGINE_QUEUE_POSITION 0
+#endif
+static constexpr bool QUEUE_POSITION = ENGINE_QUEUE_POSITION;
+
+// ENGINE_QUEUE_POSITION changes sizeof(OBSide) and sizeof(Orderbook), so
+// every unit that touches a book must be built with the same value. The book
+// types live in an inline namespace named after the layout, so C++ symbols
+// taking them differ between layouts. Every unit also references a symbol
+// that only an engine of the same layout defines. Mixing layouts fails to
+// link instead of corrupting books.
+#if ENGINE_QUEUE_POSITION
+#define ENGINE_LAYOUT layout_queue_position
+#else
+#define ENGINE_LAYOUT layout_plain
+#endif
+#define ENGINE_LAYOUT_CAT(a, b) a##b
+#define ENGINE_LAYOUT_SYMBOL(layout) ENGINE_LAYOUT_CAT(engine_, layout)
+extern "C" const int ENGINE_LAYOUT_SYMBOL(ENGINE_LAYOUT);
+[[maybe_unused]] __attribute__((used)) static const int *const
+    engine_layout_check = &ENGINE_LAYOUT_SYMBOL(ENGINE_LAYOUT);
 
 // experimenting with range and size of possible price levels
 static constexpr uint16_t BASE_PRICE = 0;
@@ -31,16 +97,121 @@ struct Order {
     Side side;
 };
 
-using Volumes = std::array<VolumeType[2], MAX_NUM_PRICES>;
-using OrderStore = std::array<Order, MAX_ORDERS>;
-using OrderBitSet = std::bitset<MAX_ORDERS>;
+using Volumes = std::array<VolumeType, MAX_NUM_PRICES>;
+using VolumeBlocks = std::array<VolumeType, NUM_VOLUME_BLOCKS>;
+// Where a resting order joined its level's queue: the ring slot it went
+// into and the quantity the level had queued in total before it. Offsets
+// wrap, but two entries of one queue are never 2^27 apart.
+struct QueueStamp {
+    uint32_t slot : 5;
+    uint32_t offset : 27;
+};
+static constexpr uint32_t QUEUE_OFFSET_MASK = (1u << 27) - 1;
+
+// Fields of a resting order besides its quantity, all written by one store
+// sequence on rest. The owner fills what would otherwise be padding.
+struct OrderInfo {
+    PriceType price;
+    Side side;
+    ParticipantType owner; // participant slot that placed the order
+    QueueStamp stamp;      // read by modify, order_id_queued, queue_position
+};
+static_assert(sizeof(OrderInfo) == 8, "eight bytes per order id");
+
+// Live orders and displayed volume queued ahead of an order at its level
+struct QueuePosition {
+    uint32_t orders_ahead;
+    VolumeType volume_ahead;
+};
+
+// Remaining quantity per order id. 0 doubles as "not resting", so there is
+// no separate active mask to probe or clear.
+using OrderQuantities = std::array<QuantityType, MAX_ORDERS>;
+using OrderInfos = std::array<OrderInfo, MAX_ORDERS>;
+// Live resting orders per participant slot and side (indexed by Side)
+using RestingCounts = std::array<std::array<uint16_t, 2>, MAX_PARTICIPANTS>;
+
+// What happens when an order would trade against a resting order of the
+// same participant. Nothing is counted as a match in any mode.
+enum class SelfTradeMode : uint8_t {
+    NONE,             // trade normally
+    CANCEL_RESTING,   // cancel the resting order, keep matching
+    CANCEL_AGGRESSOR, // cancel the rest of the incoming order
+    DECREMENT_BOTH,   // reduce both by the smaller quantity
+};
+using SelfTradeModes = std::array<SelfTradeMode, MAX_PARTICIPANTS>;
+
+// Per-participant limits as configured through set_risk_limits; 0 = no limit
+struct RiskLimits {
+    QuantityType max_order_quantity;
+    PriceType price_band; // max distance from the opposite side's best price
+    uint32_t max_order_notional; // price * quantity
+    uint32_t max_position;       // |net filled position| incl. this order
+};
+
+// Limits as checked (no-limit already widened to the type's max, so every
+// check is a plain compare) plus the running net position. 16 bytes, four
+// participants per cache line.
+struct RiskState {
+    QuantityType max_order_quantity = UINT16_MAX;
+    PriceType price_band = UINT16_MAX;
+    uint32_t max_order_notional = UINT32_MAX;
+    int32_t max_position = INT32_MAX;
+    int32_t position = 0;
+
+    // Takes on `limits`, keeping the position
+    inline void configure(const RiskLimits &limits) noexcept {
+        max_order_quantity =
+            limits.max_order_quantity ? limits.max_order_quantity : UINT16_MAX;
+        price_band = limits.price_band ? limits.price_band : UINT16_MAX;
+        max_order_notional =
+            limits.max_order_notional ? limits.max_order_notional : UINT32_MAX;
+        max_position = limits.max_position && limits.max_position < INT32_MAX
+                           ? static_cast<int32_t>(limits.max_position)
+                           : INT32_MAX;
+    }
+};
+using RiskTable = std::array<RiskState, MAX_PARTICIPANTS>;
 
+inline namespace ENGINE_LAYOUT {
 struct OBSide {
-  private:
-    using OrdQueue = CircularBuffer<IdType, MAX_ORDERS_PER_LEVEL>;
+    // The level's resting volume rides in its queue header: an add or a fill
+    // updates queue state and volume on one line
+    using OrdQueues = LevelQueues<IdType, MAX_ORDERS_PER_LEVEL, MAX_NUM_PRICES,
+                                  VolumeType>;
+    using OrdQueue = OrdQueues::Queue;
+    static_assert(OrdQueues::HEADER_SIZE * VOLUME_BLOCK_SIZE == 64,
+                  "a depth block is one line of level headers");
 
+  private:
     DecreasingSortedArray<int16_t, MAX_NUM_PRICES> _prices;
-    std::array<OrdQueue, MAX_NUM_PRICES> _orders;
+    // Queue storage comes from a pool sized by live levels, not the range
+    OrdQueues _orders;
+
+    // Sum of level volumes over each VOLUME_BLOCK_SIZE run of levels,
+    // maintained alongside them so depth queries skip whole blocks
+    alignas(64) VolumeBlocks _volume_blocks{};
+    // Iceberg volume held back from display per level; only touched when
+    // an iceberg rests on the level
+    alignas(64) Volumes _reserve_volumes{};
+
+    // Time-priority bookkeeping per level for queue_position. Rests and
+    // modifies write it, the match loop never does: fills only ever change
+    // the front, which the stamps of the first two entries account for.
+    static_assert(MAX_ORDERS_PER_LEVEL == 32, "slot masks are one uint32_t");
+    static constexpr uint32_t SLOT_MASK = MAX_ORDERS_PER_LEVEL - 1;
+    // 16-byte aligned so the three counters a rest touches share a line
+    struct alignas(16) LevelPriority {
+        uint32_t enqueued; // quantity ever queued at the level (wraps)
+        uint32_t live;     // ring slots holding uncancelled orders
+        uint32_t adjusted; // ring slots with a non-zero entry in `shrunk`
+        // Fenwick tree over ring slots of queued minus current quantity,
+        // i.e. what modifies took off each entry
+        std::array<uint32_t, MAX_ORDERS_PER_LEVEL> shrunk;
+    };
+    // Left uninitialised like the queue pool; a level's entry is reset when
+    // the level is created. Empty unless QUEUE_POSITION is on.
+    std::array<LevelPriority, QUEUE_POSITION ? MAX_NUM_PRICES : 0> _priority;
 
     // BUY (0) => +price
     // SELL (1) => -price
@@ -64,11 +235,108 @@ struct OBSide {
         return static_cast<int16_t>((p ^ static_cast<int16_t>(-s)) + s);
     }
 
+    static inline void shrink_slot(LevelPriority &priority, uint32_t slot,
+                                   uint32_t delta) noexcept {
+        for (uint32_t i = slot + 1; i <= MAX_ORDERS_PER_LEVEL; i += i & -i)
+            priority.shrunk[i - 1] += delta;
+    }
+    // Sum of `shrunk` over slots [0, end)
+    static inline uint32_t shrunk_before(const LevelPriority &priority,
+                                         uint32_t end) noexcept {
+        uint32_t total = 0;
+        for (uint32_t i = end; i; i &= i - 1)
+            total += priority.shrunk[i - 1];
+        return total;
+    }
+    // Sum of `shrunk` over `count` ring slots starting at `first`
+    static inline uint32_t shrunk_between(const LevelPriority &priority,
+                                          uint32_t first,
+                                          uint32_t count) noexcept {
+        const uint32_t end = first + count;
+        if (end <= MAX_ORDERS_PER_LEVEL)
+            return shrunk_before(priority, end) -
+                   shrunk_before(priority, first);
+        return shrunk_before(priority, MAX_ORDERS_PER_LEVEL) -
+               shrunk_before(priority, first) +
+               shrunk_before(priority, end - MAX_ORDERS_PER_LEVEL);
+    }
+
   public:
-    __attribute__((always_inline, hot)) inline std::pair<OrdQueue *, PriceType>
+    // Keeps value-initialisation from zeroing the untouched queue pool
+    OBSide() noexcept {}
+
+    inline bool empty() const noexcept { return _prices.empty(); }
+    // Levels on the ladder, including ones emptied by lazy cancels
+    inline size_t level_count() const noexcept { return _prices.size(); }
+
+    // Most competitive level whose queue is non-empty. Cancels are lazy, so
+    // the level may have no volume left, but no live level is ever more
+    // competitive than this one.
+    inline PriceType best_price() const noexcept {
+        return std::abs(_prices.back()) - BASE_PRICE;
+    }
+
+    // Most competitive level with volume left, past any levels that only
+    // lazily cancelled entries keep on the ladder. False if there is none.
+    inline bool live_best_price(PriceType &level) const noexcept {
+        for (size_t i = _prices.size(); i-- > 0;) {
+            level = std::abs(_prices[i]) - BASE_PRICE;
+            if (volume_at(level))
+                return true;
+        }
+        return false;
+    }
+
+    // Cache hints for callers that interleave several books (see
+    // book_scheduler.hpp). Each step only reads lines the one before warmed:
+    // ladder size -> ladder tail -> level header -> level front.
+    inline void prefetch_ladder() const noexcept { _prices.prefetch_size(); }
+    inline void prefetch_best() const noexcept { _prices.prefetch_back(); }
+    inline void prefetch_level(PriceType level) const noexcept {
+        _orders.prefetch_level(level);
+        __builtin_prefetch(&_volume_blocks[level / VOLUME_BLOCK_SIZE]);
+    }
+    inline void prefetch_level_front(PriceType level) const noexcept {
+        _orders.prefetch_front(level);
+    }
+
+    inline const VolumeBlocks &volume_blocks() const noexcept {
+        return _volume_blocks;
+    }
+
+    // Entries queued at a level, cancelled ones included
+    inline uint32_t depth_at(PriceType level) const noexcept {
+        return _orders.size(level);
+    }
+
+    __attribute__((always_inline, hot)) inline const VolumeType &
+    volume_at(PriceType level) const noexcept {
+        return _orders.payload(level);
+    }
+
+    // Applies a volume change to a level and its depth-index block
+    __attribute__((always_inline, hot)) inline void
+    adjust_volume(PriceType level, VolumeType delta) noexcept {
+        _orders.payload(level) += delta;
+        _volume_blocks[level / VOLUME_BLOCK_SIZE] += delta;
+    }
+
+    inline VolumeType reserve_at(PriceType level) const noexcept {
+        return _reserve_volumes[level];
+    }
+    inline const Volumes &reserve_volumes() const noexcept {
+        return _reserve_volumes;
+    }
+    inline void adjust_reserve(PriceType level, VolumeType delta) noexcept {
+        _reserve_volumes[level] += delta;
+    }
+
+    inline const OrdQueues &queues() const noexcept { return _orders; }
+
+    __attribute__((always_inline, hot)) inline std::pair<OrdQueue, PriceType>
     get_best_nonempty() {
-        auto best_price = std::abs(_prices.back()) - BASE_PRICE;
-        return {&_orders[best_price], best_price};
+        PriceType best_price = std::abs(_prices.back()) - BASE_PRICE;
+        return {_orders[best_price], best_price};
     }
 
     __attribute__((always_inline, hot)) inline void remove_best() noexcept {
@@ -93,23 +361,143 @@ struct OBSide {
         return key >= _prices.back();
     }
 
-    __attribute__((always_inline, hot)) inline void
-    add_order(Order &order) noexcept {
-        if (_orders[order.price - BASE_PRICE].push_back(order.id)) {
+    // Queues the order at its level and stamps its place in the queue. The
+    // ladder only learns about a level when it is created, which the header
+    // load already tells us. Returns false, changing nothing, if the level's
+    // queue is full.
+    __attribute__((always_inline, hot)) inline bool
+    add_order(Order &order, QueueStamp &stamp) noexcept {
+        const PriceType level = order.price - BASE_PRICE;
+        OrdQueue queue = _orders[level];
+        const bool new_level = queue.empty();
+        if (!queue.push_back(order.id)) [[unlikely]]
+            return false;
+        if (new_level) {
             _prices.insert(stored_key(order.price, order.side));
+            if constexpr (QUEUE_POSITION) {
+                LevelPriority &priority = _priority[level];
+                priority.enqueued = priority.live = priority.adjusted = 0;
+                priority.shrunk.fill(0);
+            }
+        }
+        stamp = stamp_back(level, queue, order.quantity);
+        adjust_volume(level, order.quantity);
+        return true;
+    }
+
+    // Time-priority bookkeeping for an entry of `quantity` just pushed at
+    // the back of `queue` (the queue of `level`)
+    inline QueueStamp stamp_back(PriceType level, OrdQueue queue,
+                                 QuantityType quantity) noexcept {
+        const uint32_t slot =
+            (queue.front_slot() + queue.size() - 1) & SLOT_MASK;
+        if constexpr (!QUEUE_POSITION)
+            return {slot, 0};
+
+        LevelPriority &priority = _priority[level];
+        const uint32_t bit = 1u << slot;
+        // The slot's last occupant was modified: clear what it left behind
+        if (priority.adjusted & bit) [[unlikely]] {
+            shrink_slot(priority, slot,
+                        shrunk_before(priority, slot) -
+                            shrunk_before(priority, slot + 1));
+            priority.adjusted &= ~bit;
         }
+        priority.live |= bit;
+        const QueueStamp stamp{slot, priority.enqueued & QUEUE_OFFSET_MASK};
+        priority.enqueued += quantity;
+        return stamp;
+    }
+
+    // A resting order's quantity was changed from `from` to `to` outside the
+    // match loop (0 cancels it)
+    inline void note_modify(PriceType level, const QueueStamp &stamp,
+                            QuantityType from, QuantityType to) noexcept {
+        if constexpr (!QUEUE_POSITION)
+            return;
+        LevelPriority &priority = _priority[level];
+        const uint32_t bit = 1u << stamp.slot;
+        shrink_slot(priority, stamp.slot, static_cast<uint32_t>(from - to));
+        priority.adjusted |= bit;
+        if (!to)
+            priority.live &= ~bit;
+    }
+
+    // Whether the queue entry stamped `stamp` at `level` is still queued
+    // (live or lazily cancelled) and still belongs to `id`
+    inline bool still_queued(PriceType level, const QueueStamp &stamp,
+                             IdType id) const noexcept {
+        return _orders.holds(level, stamp.slot, id);
+    }
+
+    // Live orders and displayed volume ahead of the resting order stamped
+    // `stamp` at `level`, in O(log MAX_ORDERS_PER_LEVEL). Everything queued
+    // from the second entry up to the order is the difference of their
+    // stamps, less what modifies took off it since; the front's current
+    // quantity is read directly, as it is the only entry fills touch.
+    inline QueuePosition position_of(PriceType level, const QueueStamp &stamp,
+                                     const OrderQuantities &quantities,
+                                     const OrderInfos &infos) noexcept {
+        OrdQueue queue = _orders[level];
+        const uint32_t front = queue.front_slot();
+        const uint32_t ahead = (stamp.slot - front) & SLOT_MASK;
+        if (!ahead)
+            return {0, 0};
+
+        const LevelPriority &priority = _priority[level];
+        const QuantityType front_quantity = quantities[queue.front()];
+        const uint32_t first = (front + 1) & SLOT_MASK;
+        const uint32_t between = ahead - 1;
+        const uint32_t live = std::rotr(priority.live, static_cast<int>(first)) &
+                              ((1u << between) - 1);
+        const uint32_t queued =
+            (stamp.offset - infos[queue.peek(1)].stamp.offset) &
+            QUEUE_OFFSET_MASK;
+        return {static_cast<uint32_t>(front_quantity != 0) +
+                    static_cast<uint32_t>(std::popcount(live)),
+                queued - shrunk_between(priority, first, between) +
+                    front_quantity};
     }
 };
 
 // You CAN and SHOULD change this
 struct Orderbook {
-    alignas(64) OBSide _buy_levels{};
-    alignas(64) OBSide _sell_levels{};
+    // While set, match_order only rests orders; uncross() executes them
+    bool _in_auction = false;
+    // Resting orders per side (indexed by Side) that still hold reserve
+    // quantity, so the match loop only looks at reserves when one can exist
+    std::array<uint16_t, 2> _iceberg_counts{};
+    // Participants with a self-trade mode set. While zero, _resting_counts
+    // is not maintained and fills never read the resting order's owner.
+    uint16_t _self_trade_participants = 0;
+    // Rests turned away because their level's queue already held
+    // MAX_ORDERS_PER_LEVEL entries. The match count cannot say so, so
+    // callers compare this before and after an order (get_dropped_rests).
+    uint32_t _dropped_rests = 0;
+
+    // Indexed by Side: [0] holds resting BUY orders, [1] resting SELL orders
+    alignas(64) std::array<OBSide, 2> _levels{};
+
+    // Hot/cold split of the order store: the match loop reads and writes
+    // _order_quantities and only reads the owner from _order_infos for the
+    // orders it fills
+    alignas(64) OrderQuantities _order_quantities{};
+    alignas(64) OrderInfos _order_infos{};
+
+    // Per-participant state for self-trade prevention. Counts are only kept
+    // while _self_trade_participants is non-zero (rebuilt when it becomes so)
+    alignas(64) RestingCounts _resting_counts{};
+    alignas(64) SelfTradeModes _self_trade_modes{};
+
+    // Iceberg side table: quantity still hidden and the display size each
+    // replenishment shows. Zero reserve = not (or no longer) an iceberg
+    alignas(64) OrderQuantities _order_reserves{};
+    alignas(64) OrderQuantities _order_displays{};
 
-    alignas(64) std::array<VolumeType[2], MAX_NUM_PRICES> _volumes{};
-    alignas(64) std::array<Order, MAX_ORDERS> _orders{};
-    alignas(64) std::bitset<MAX_ORDERS> _orders_active{};
+    // Risk stage state, only touched when RISK_CHECKS is on
+    alignas(64) RiskTable _risk{};
 };
+} // namespace ENGINE_LAYOUT
 
 extern "C" {
 // Takes in an incoming order, matches it, and returns the number of matches
@@ -117,16 +505,110 @@ extern "C" {
 
 uint32_t match_order(Orderbook &orderbook, const Order &incoming) noexcept;
 
+// match_order on behalf of a participant slot, which owns the order if it
+// rests and selects the self-trade mode. With RISK_CHECKS on, the
+// order is first checked against the slot's limits and RISK_REJECTED is
+// returned (nothing matched, nothing rests) if it breaches one. match_order
+// is this with slot 0.
+uint32_t match_order_as(Orderbook &orderbook, const Order &incoming,
+                        ParticipantType participant) noexcept;
+
+// match_order_as for an iceberg order. It trades its full quantity on
+// arrival, but whatever rests shows at most `display_quantity` at a time;
+// the rest is held in reserve. Each time the displayed part is filled it is
+// replenished from the reserve and re-queued at the back of its level.
+// display_quantity == 0 (or >= the quantity) rests a plain order
+uint32_t match_iceberg_as(Orderbook &orderbook, const Order &incoming,
+                          QuantityType display_quantity,
+                          ParticipantType participant) noexcept;
+
+// Configures self-trade prevention for a participant slot. Slot 0 (plain
+// match_order) is never checked.
+void set_self_trade_mode(Orderbook &orderbook, ParticipantType participant,
+                         SelfTradeMode mode) noexcept;
+
+// Configures the limits checked for a participant slot
+void set_risk_limits(Orderbook &orderbook, ParticipantType participant,
+                     const RiskLimits &limits) noexcept;
+
+// Net filled position of a participant slot (BUY positive)
+int32_t get_position(Orderbook &orderbook,
+                     ParticipantType participant) noexcept;
+
+// Switches the book to auction mode: match_order / match_order_as rest every
+// accepted order without matching, so the book may cross, until uncross()
+void begin_auction(Orderbook &orderbook) noexcept;
+
+// Price that maximises executed volume if the book were uncrossed now, ties
+// broken by the smallest buy/sell imbalance and then the middle of the tied
+// range. Returns false (outputs untouched) if the book is not crossed
+bool get_equilibrium(Orderbook &orderbook, PriceType &price,
+                     uint32_t &volume) noexcept;
+
+// Executes every crossing order at the equilibrium price in price-time
+// priority and returns the book to continuous matching. Returns the number
+// of matches; self-trade prevention does not apply to the uncross
+uint32_t uncross(Orderbook &orderbook) noexcept;
+
 // Sets the new quantity of an order. If new_quantity==0, removes the order
+// For an iceberg this is the displayed quantity; 0 also drops its reserve
 void modify_order_by_id(Orderbook &orderbook, IdType order_id,
                         QuantityType new_quantity) noexcept;
 
-// Returns total resting volume at a given price point
+// Returns total resting (displayed) volume at a given price point
 uint32_t get_volume_at_level(Orderbook &orderbook, Side side,
                              PriceType price) noexcept;
 
+// Displayed plus iceberg reserve volume at a given price point
+uint32_t get_total_volume_at_level(Orderbook &orderbook, Side side,
+                                   PriceType price) noexcept;
+
+// Returns total resting volume on `side` at prices at least as competitive as
+// `price` (BUY: >= price, SELL: <= price)
+uint32_t get_volume_up_to_price(Orderbook &orderbook, Side side,
+                                PriceType price) noexcept;
+
+// Returns total resting volume on `side` within `ticks` of its best price
+uint32_t get_volume_within_ticks(Orderbook &orderbook, Side side,
+                                 PriceType ticks) noexcept;
+
+// Finds the worst price reached when taking `quantity` from the resting
+// orders on `side`, starting at its best price. Returns false (leaving
+// `worst_price` untouched) if `side` holds less than `quantity`
+bool get_price_for_quantity(Orderbook &orderbook, Side side, uint32_t quantity,
+                            PriceType &worst_price) noexcept;
+
+#if ENGINE_QUEUE_POSITION
+// Live orders and displayed volume queued ahead of a resting order at its
+// price level, without walking the queue. Returns false (leaving `position`
+// untouched) if the order is not resting
+bool queue_position(Orderbook &orderbook, IdType order_id,
+                    QueuePosition &position) noexcept;
+#endif
+
+// True while `order_id` has an entry in a level queue: resting, or cancelled
+// and not yet trimmed by the match loop. A new order must not reuse such an
+// id, as the stale entry would match again under the new order's quantity.
+bool order_id_queued(const Orderbook &orderbook, IdType order_id) noexcept;
+
+// Orders whose remainder was dropped instead of resting because its level's
+// queue was full. Their matches still count and are still returned.
+uint32_t get_dropped_rests(const Orderbook &orderbook) noexcept;
+
 // Performance of these do not matter. They are only used to check correctness
 Order lookup_order_by_id(Orderbook &orderbook, IdType order_id);
 bool order_exists(Orderbook &orderbook, IdType order_id);
 Orderbook *create_orderbook();
 }
+
+namespace engine_detail {
+// match_iceberg_as (display_quantity 0 for a plain order) for the staged
+// pipeline, whose risk stage has already checked the order's quantity and
+// notional. Only position and price band, which depend on fills and the
+// book, are checked here. Not part of the C API, and hidden from the shared
+// library's exports, so no other caller can skip those checks.
+__attribute__((visibility("hidden"))) uint32_t
+match_prechecked(Orderbook &orderbook, const Order &incoming,
+                 QuantityType display_quantity,
+                 ParticipantType participant) noexcept;
+} // namespace engine_detail
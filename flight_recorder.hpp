@@ -0,0 +1,172 @@
+#pragma once
+
+#include "engine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <x86intrin.h>
+
+/*
+Flight recorder: the last CAPACITY operations each thread ran through the
+engine, for tracing a latency spike back to the book state that caused it.
+
+Every match_order* / modify_order_by_id / uncross call appends one 32-byte
+record to a ring owned by the calling thread: what the op was and what it
+did to the book (levels crossed, cancelled entries trimmed, depth of the
+last queue it touched). Writing a record is a relaxed load of the trigger
+threshold and stores into a line the thread wrote last time; no locks,
+atomic writes or syscalls.
+
+An rdtsc costs about as much as a hot op (~40 cycles on a VM), so only one
+op in FLIGHT_TIMING_INTERVAL reads it, at entry, and none reads it at exit.
+A timed record's cycles are filled in when the next timed op starts: the
+ticks across the FLIGHT_TIMING_INTERVAL ops from one to the other, plus
+whatever the caller did in between. In a busy loop that is the ops; after
+an idle gap it includes the gap. Untimed records, and the latest timed one,
+read 0 for both.
+
+The ring is read back on the thread that owns it: on demand through
+flight_records() / dump_flight_recorder(), or automatically through the
+trigger set by set_flight_trigger(), which runs at the next timed op for any
+timed record whose cycles exceed the threshold.
+
+The recorder is on by default, for post-mortems in production builds;
+-DENGINE_FLIGHT_RECORDER=0 (make FLIGHT=0) compiles every call below away.
+*/
+
+enum class FlightOp : uint8_t { MATCH, MODIFY, UNCROSS };
+
+struct FlightRecord {
+    uint64_t entry;   // rdtsc when the op started; timed ops only
+    uint32_t cycles;  // ticks until the next timed op started, 0 until then
+    IdType order_id;  // MATCH / MODIFY
+    PriceType price;  // order price; uncross: the equilibrium price
+    QuantityType quantity; // MATCH: incoming, MODIFY: new quantity
+    uint16_t matches; // saturates; FLIGHT_RISK_REJECTED for a risk reject
+    uint16_t levels_crossed; // price levels the order walked through
+    uint16_t trimmed;        // cancelled entries popped on the way
+    uint8_t queue_depth;     // entries in the last level queue touched
+    FlightOp op;
+    Side side;
+    ParticipantType participant;
+    uint16_t reserved;
+};
+static_assert(sizeof(FlightRecord) == 32, "two records per cache line");
+
+static constexpr uint16_t FLIGHT_RISK_REJECTED = UINT16_MAX;
+
+// What the match loop reports about one order, for its flight record
+struct MatchTrace {
+    uint32_t levels_crossed = 0;
+    uint32_t trimmed = 0;
+    uint32_t queue_depth = 0;
+};
+
+struct FlightRecorder {
+    static constexpr uint32_t CAPACITY = 1024; // a power of two
+    FlightRecord *records = nullptr; // CAPACITY of them, from the first op
+    uint64_t written = 0; // records ever appended; the ring holds the last
+};
+
+// Called with the record of the op that crossed the threshold, on the
+// thread that ran it
+using FlightTrigger = void (*)(const FlightRecord &record);
+
+// Runs `trigger` with every timed record whose cycles exceed
+// `threshold_cycles` rdtsc ticks, at the end of the thread's next timed op.
+// A null trigger (the default) disables it.
+void set_flight_trigger(uint64_t threshold_cycles,
+                        FlightTrigger trigger) noexcept;
+
+// Copies up to `max` of the calling thread's latest records, oldest first.
+// Returns how many were copied.
+std::size_t flight_records(FlightRecord *out, std::size_t max) noexcept;
+
+// Writes the calling thread's records to `out`, one line each, oldest first
+void dump_flight_recorder(std::FILE *out) noexcept;
+
+namespace flight_detail {
+
+// Only the ring's cursor is thread_local (the records are heap-allocated on
+// a thread's first op), so it fits the static TLS a dlopen'ed engine.so gets
+inline thread_local FlightRecorder recorder
+    __attribute__((tls_model("initial-exec")));
+
+inline std::atomic<uint64_t> trigger_threshold{UINT64_MAX};
+inline std::atomic<FlightTrigger> trigger{nullptr};
+
+// Allocates the calling thread's records; false if that failed
+bool create_records() noexcept;
+
+inline __attribute__((always_inline)) uint16_t saturate(uint32_t value) {
+    return value < UINT16_MAX ? static_cast<uint16_t>(value) : UINT16_MAX - 1;
+}
+
+} // namespace flight_detail
+
+// Entry timestamp of an op, 0 if it is not timed. Also starts loading the
+// trigger threshold, so with a cold cache flight_record() does not wait on
+// it after the op.
+inline __attribute__((always_inline, hot)) uint64_t flight_clock() noexcept {
+    if constexpr (FLIGHT_RECORDER) {
+        __builtin_prefetch(&flight_detail::trigger_threshold);
+        if (flight_detail::recorder.written & (FLIGHT_TIMING_INTERVAL - 1))
+            return 0;
+        return __rdtsc();
+    }
+    return 0;
+}
+
+// Appends one record for an op that started at `entry`. A timed op also
+// closes the previous timed record with its own entry.
+inline __attribute__((always_inline, hot)) void
+flight_record(FlightOp op, uint64_t entry, const Order &order,
+              ParticipantType participant, uint32_t matches,
+              const MatchTrace &trace) noexcept {
+    if constexpr (!FLIGHT_RECORDER)
+        return;
+    FlightRecorder &recorder = flight_detail::recorder;
+    if (!recorder.records) [[unlikely]] {
+        if (!flight_detail::create_records())
+            return;
+    }
+
+    constexpr uint32_t MASK = FlightRecorder::CAPACITY - 1;
+    static_assert(FLIGHT_TIMING_INTERVAL <= FlightRecorder::CAPACITY);
+    FlightRecord &previous =
+        recorder.records[(recorder.written - FLIGHT_TIMING_INTERVAL) & MASK];
+    const uint64_t elapsed =
+        entry && recorder.written ? entry - previous.entry : 0;
+    if (entry)
+        previous.cycles =
+            static_cast<uint32_t>(std::min<uint64_t>(elapsed, UINT32_MAX));
+
+    FlightRecord &record = recorder.records[recorder.written++ & MASK];
+    record.entry = entry;
+    record.cycles = 0;
+    record.order_id = order.id;
+    record.price = order.price;
+    record.quantity = order.quantity;
+    record.matches = matches == RISK_REJECTED
+                         ? FLIGHT_RISK_REJECTED
+                         : flight_detail::saturate(matches);
+    record.levels_crossed = flight_detail::saturate(trace.levels_crossed);
+    record.trimmed = flight_detail::saturate(trace.trimmed);
+    record.queue_depth = static_cast<uint8_t>(trace.queue_depth);
+    record.op = op;
+    record.side = order.side;
+    record.participant = participant;
+    record.reserved = 0;
+
+    if (elapsed >
+        flight_detail::trigger_threshold.load(std::memory_order_relaxed))
+        [[unlikely]] {
+        const FlightTrigger trigger =
+            flight_detail::trigger.load(std::memory_order_acquire);
+        if (trigger)
+            trigger(previous);
+    }
+}
@@ -0,0 +1,117 @@
+#include "gateway.hpp"
+
+#include <cerrno>
+#include <sys/socket.h>
+
+Gateway::Gateway(Orderbook &orderbook, int fd) noexcept
+    : book_(orderbook), fd_(fd) {}
+
+template <bool Prechecked>
+static inline __attribute__((always_inline)) void
+apply_request(Orderbook &orderbook, const WireRequest &request,
+              WireResponse &response) noexcept {
+    const bool resting = orderbook._order_quantities[request.order_id] != 0;
+
+    if (request.type == WireType::MODIFY) {
+        if (!resting) [[unlikely]] {
+            response.status = WireStatus::UNKNOWN_ORDER;
+            return;
+        }
+        modify_order_by_id(orderbook, request.order_id, request.quantity);
+        return;
+    }
+
+    // Order ids must be unique among queued entries, including cancelled
+    // ones the match loop has not trimmed yet
+    if (resting || order_id_queued(orderbook, request.order_id)) [[unlikely]] {
+        response.status = WireStatus::DUPLICATE_ID;
+        return;
+    }
+    const Order order{request.order_id, request.price, request.quantity,
+                      request.side};
+    const uint32_t dropped = orderbook._dropped_rests;
+    uint32_t matches;
+    if constexpr (Prechecked)
+        matches = engine_detail::match_prechecked(
+            orderbook, order, request.display, request.participant);
+    else
+        matches = request.display
+                      ? match_iceberg_as(orderbook, order, request.display,
+                                         request.participant)
+                      : match_order_as(orderbook, order, request.participant);
+    if (matches == RISK_REJECTED) [[unlikely]] {
+        response.status = WireStatus::RISK_REJECTED;
+        return;
+    }
+    response.matches = matches;
+    // The matches stand; only the rest that should have followed is lost
+    if (orderbook._dropped_rests != dropped) [[unlikely]]
+        response.status = WireStatus::LEVEL_FULL;
+}
+
+void apply_wire_request(Orderbook &orderbook, const WireRequest &request,
+                        WireResponse &response) noexcept {
+    apply_request<false>(orderbook, request, response);
+}
+
+void gateway_detail::apply_prechecked_wire_request(
+    Orderbook &orderbook, const WireRequest &request,
+    WireResponse &response) noexcept {
+    apply_request<true>(orderbook, request, response);
+}
+
+std::size_t Gateway::handle(const WireRequest *requests, std::size_t count,
+                            WireResponse *responses) noexcept {
+    for (std::size_t i = 0; i < count; ++i) {
+        const WireRequest &request = requests[i];
+        // Both request kinds start at the order's quantity slot, and new
+        // orders check its info slot; warm the next ones while this one
+        // matches
+        if (i + 1 < count) [[likely]] {
+            const IdType next = requests[i + 1].order_id % MAX_ORDERS;
+            __builtin_prefetch(&book_._order_quantities[next]);
+            __builtin_prefetch(&book_._order_infos[next]);
+        }
+
+        WireResponse &response = responses[i];
+        response = WireResponse{sizeof(WireResponse), request.type,
+                                WireStatus::ACCEPTED, request.order_id, 0,
+                                sequence_++};
+
+        if (!wire_request_valid(request)) [[unlikely]] {
+            response.status = WireStatus::MALFORMED;
+            continue;
+        }
+        apply_wire_request(book_, request, response);
+    }
+    return count;
+}
+
+int Gateway::poll() noexcept {
+    ssize_t received;
+    do {
+        received = recv(fd_, rx_.data(), sizeof(rx_), 0);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0)
+        return received == 0 ? 0 : -1;
+
+    std::size_t count = static_cast<std::size_t>(received) /
+                        sizeof(WireRequest);
+    if (received % sizeof(WireRequest) != 0 || count > MAX_BATCH)
+        [[unlikely]] {
+        tx_[0] = WireResponse{sizeof(WireResponse), WireType{0},
+                              WireStatus::MALFORMED, 0, 0, sequence_++};
+        count = 0;
+    }
+    const std::size_t responses =
+        count ? handle(rx_.data(), count, tx_.data()) : 1;
+
+    const std::size_t bytes = responses * sizeof(WireResponse);
+    ssize_t sent;
+    do {
+        sent = send(fd_, tx_.data(), bytes, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != static_cast<ssize_t>(bytes))
+        return -1;
+    return static_cast<int>(responses);
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "engine.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+Binary order gateway over a message-preserving socket (a unix SOCK_SEQPACKET
+socketpair, or a datagram socket).
+
+Every message is a fixed 16-byte little-endian record, and one packet carries
+up to MAX_BATCH of them back to back. The gateway receives a packet straight
+into an aligned buffer of WireRequest, validates each record where it lies,
+builds the Order on the stack and runs the whole packet through the book
+before answering with one packet of WireResponse, one per request and in the
+same order. Nothing is copied between the socket buffer and match_order_as,
+and nothing is allocated after construction.
+*/
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "wire records are read in place as little-endian");
+
+enum class WireType : uint8_t { NEW_ORDER = 1, MODIFY = 2 };
+
+enum class WireStatus : uint8_t {
+    ACCEPTED,
+    RISK_REJECTED, // the risk stage refused the order
+    UNKNOWN_ORDER, // modify of an order that is not resting
+    DUPLICATE_ID,  // new order whose id is resting, or cancelled but queued
+    MALFORMED,     // bad field, or the whole packet if its size is wrong
+    LEVEL_FULL,    // new order's remainder dropped: its level's queue is full
+};
+
+struct WireRequest {
+    uint16_t length; // sizeof(WireRequest)
+    WireType type;
+    Side side; // NEW_ORDER only
+    IdType order_id;
+    PriceType price;       // NEW_ORDER only
+    QuantityType quantity; // NEW_ORDER: order size, MODIFY: new size (0 cancels)
+    QuantityType display;  // NEW_ORDER: iceberg display size, 0 = plain
+    ParticipantType participant; // NEW_ORDER only
+    uint8_t reserved;            // must be 0
+};
+static_assert(sizeof(WireRequest) == 16, "requests are read in place");
+
+struct WireResponse {
+    uint16_t length; // sizeof(WireResponse)
+    WireType type;   // echoes the request, 0 for a malformed packet
+    WireStatus status;
+    IdType order_id;
+    uint32_t matches;  // NEW_ORDER: match_order_as result
+    uint32_t sequence; // running count of requests seen by the gateway
+};
+static_assert(sizeof(WireResponse) == 16, "responses are written in place");
+
+inline WireRequest wire_new_order(const Order &order,
+                                  ParticipantType participant = 0,
+                                  QuantityType display = 0) noexcept {
+    return WireRequest{sizeof(WireRequest), WireType::NEW_ORDER, order.side,
+                       order.id, order.price, order.quantity, display,
+                       participant, 0};
+}
+
+inline WireRequest wire_modify(IdType order_id,
+                               QuantityType new_quantity) noexcept {
+    return WireRequest{sizeof(WireRequest), WireType::MODIFY, Side::BUY,
+                       order_id, 0, new_quantity, 0, 0, 0};
+}
+
+// Field checks for one request, done on the record where it was received.
+// Combined with & rather than && so they compile to compares, not branches.
+inline __attribute__((always_inline, hot)) bool
+wire_request_valid(const WireRequest &request) noexcept {
+    const bool header = (request.length == sizeof(WireRequest)) &
+                        (request.reserved == 0) &
+                        (request.order_id < MAX_ORDERS);
+    if (request.type == WireType::MODIFY)
+        return header;
+    return header & (request.type == WireType::NEW_ORDER) &
+           (static_cast<uint8_t>(request.side) <= 1) &
+           (static_cast<PriceType>(request.price - BASE_PRICE) <
+            MAX_NUM_PRICES) &
+           (request.quantity != 0);
+}
+
+// Applies one valid request to `orderbook` and records the outcome in
+// `response` (status and match count; the rest is left to the caller)
+void apply_wire_request(Orderbook &orderbook, const WireRequest &request,
+                        WireResponse &response) noexcept;
+
+namespace gateway_detail {
+// apply_wire_request for the staged pipeline, whose risk stage has already
+// checked quantity and notional (engine_detail::match_prechecked). Hidden
+// like the engine entry it calls.
+__attribute__((visibility("hidden"))) void
+apply_prechecked_wire_request(Orderbook &orderbook, const WireRequest &request,
+                              WireResponse &response) noexcept;
+} // namespace gateway_detail
+
+class Gateway {
+  public:
+    static constexpr std::size_t MAX_BATCH = 64; // requests per packet
+
+    // Serves `orderbook` on `fd`, which the caller owns
+    Gateway(Orderbook &orderbook, int fd) noexcept;
+
+    Gateway(const Gateway &) = delete;
+    Gateway &operator=(const Gateway &) = delete;
+
+    // Blocks for one packet, applies it and sends the responses. Returns the
+    // number of responses sent, 0 once the peer has closed, or -1 on a
+    // socket error. A packet that is not a whole number of requests or is
+    // longer than MAX_BATCH is not applied and gets a single MALFORMED
+    // response.
+    int poll() noexcept;
+
+    // The part of poll() between the socket calls: validates and applies
+    // requests[0, count) and writes one response each. Returns count.
+    std::size_t handle(const WireRequest *requests, std::size_t count,
+                       WireResponse *responses) noexcept;
+
+  private:
+    Orderbook &book_;
+    int fd_;
+    uint32_t sequence_ = 0;
+
+    // One extra slot so an oversized packet shows up as such
+    alignas(64) std::array<WireRequest, MAX_BATCH + 1> rx_;
+    alignas(64) std::array<WireResponse, MAX_BATCH> tx_;
+};
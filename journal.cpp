@@ -0,0 +1,344 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// FNV-1a over everything before the checksum field
+static uint32_t record_checksum(const JournalRecord &record) noexcept {
+    const auto *bytes = reinterpret_cast<const unsigned char *>(&record);
+    uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < offsetof(JournalRecord, checksum); ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+// pwritev until every byte of `iov` is written at `offset`, advancing it
+static bool write_all(int fd, iovec *iov, int iov_count,
+                      off_t &offset) noexcept {
+    while (iov_count) {
+        const ssize_t n = pwritev(fd, iov, iov_count, offset);
+        if (n <= 0)
+            return false;
+        offset += n;
+
+        std::size_t done = n;
+        while (iov_count && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            ++iov;
+            --iov_count;
+        }
+        if (iov_count) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + done;
+            iov->iov_len -= done;
+        }
+    }
+    return true;
+}
+
+Journal::Journal(const char *path, std::chrono::microseconds commit_interval)
+    : commit_interval_(commit_interval) {
+    fd_ = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0)
+        throw std::runtime_error("Cannot open journal");
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close(fd_);
+        throw std::runtime_error("Cannot stat journal");
+    }
+
+    // A crash can leave a partial record at the tail, or whole records
+    // whose data never reached the disk (zeros, or a torn mix of old and new
+    // bytes). Drop those after the last record that checks out, but only a
+    // torn write's worth: bytes with no good record before them are not a
+    // journal this code wrote, and are left alone.
+    const off_t whole = st.st_size - st.st_size % sizeof(JournalRecord);
+    const off_t floor =
+        std::max<off_t>(0, whole - static_cast<off_t>(MAX_TORN_RECORDS *
+                                                      sizeof(JournalRecord)));
+    offset_ = whole;
+    JournalRecord last;
+    bool found = false;
+    while (!found && offset_ > floor) {
+        if (pread(fd_, &last, sizeof(last), offset_ - sizeof(last)) !=
+            sizeof(last)) {
+            close(fd_);
+            throw std::runtime_error("Cannot read journal");
+        }
+        found = last.checksum == record_checksum(last);
+        if (!found)
+            offset_ -= sizeof(JournalRecord);
+    }
+    if (!found && st.st_size > 0) {
+        close(fd_);
+        throw std::runtime_error("No valid journal record at the tail");
+    }
+    if (found)
+        next_sequence_ = last.sequence + 1;
+    if (offset_ != st.st_size && ftruncate(fd_, offset_) != 0) {
+        close(fd_);
+        throw std::runtime_error("Cannot truncate journal");
+    }
+    durable_.store(next_sequence_ - 1, std::memory_order_relaxed);
+
+    writer_ = std::thread([this] { writer_loop(); });
+}
+
+Journal::~Journal() {
+    stop_.store(true, std::memory_order_release);
+    writer_.join();
+    close(fd_);
+}
+
+uint64_t Journal::append(JournalRecord record) noexcept {
+    record.sequence = next_sequence_++;
+    std::memset(record.reserved, 0, sizeof(record.reserved));
+    record.checksum = record_checksum(record);
+    while (!ring_.try_push(record)) [[unlikely]]
+        _mm_pause();
+    return record.sequence;
+}
+
+bool Journal::wait_durable(uint64_t sequence) const noexcept {
+    while (durable_sequence() < sequence) {
+        if (failed())
+            return false;
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+void Journal::writer_loop() {
+    using clock = std::chrono::steady_clock;
+    auto last_sync = clock::now();
+    uint64_t written = durable_.load(std::memory_order_relaxed);
+    bool dirty = false;
+
+    for (;;) {
+        const bool stopping = stop_.load(std::memory_order_acquire);
+
+        // Everything queued, as one pwritev of up to two runs (before and
+        // after the ring wraps)
+        const auto runs = ring_.readable();
+        const std::size_t records = runs.size();
+        if (records) {
+            iovec iov[2] = {
+                {const_cast<JournalRecord *>(runs.first),
+                 runs.first_count * sizeof(JournalRecord)},
+                {const_cast<JournalRecord *>(runs.second),
+                 runs.second_count * sizeof(JournalRecord)}};
+            const int iov_count = runs.second_count ? 2 : 1;
+            const JournalRecord &last = runs.second_count
+                                            ? runs.second[runs.second_count - 1]
+                                            : runs.first[runs.first_count - 1];
+
+            // After a failure records are still consumed (and lost) so the
+            // engine thread never stalls on a dead journal
+            if (!failed()) {
+                if (write_all(fd_, iov, iov_count, offset_)) {
+                    written = last.sequence;
+                    dirty = true;
+                } else {
+                    // Nothing written from here on will be synced
+                    failed_.store(true, std::memory_order_release);
+                    dirty = false;
+                }
+            }
+            ring_.consume(records);
+        }
+
+        const auto now = clock::now();
+        if (dirty && !failed() &&
+            (stopping || now - last_sync >= commit_interval_)) {
+            if (fdatasync(fd_) == 0)
+                durable_.store(written, std::memory_order_release);
+            else
+                failed_.store(true, std::memory_order_release);
+            dirty = false;
+            last_sync = now;
+        }
+
+        if (!records) {
+            if (stopping && ring_.empty() && !dirty)
+                return;
+            std::this_thread::sleep_for(
+                std::min(commit_interval_ / 4, std::chrono::microseconds(50)));
+        }
+    }
+}
+
+uint32_t journaled_match_order(Journal &journal, Orderbook &orderbook,
+                               const Order &incoming,
+                               ParticipantType participant) noexcept {
+    const uint32_t result = match_order_as(orderbook, incoming, participant);
+    if (result == RISK_REJECTED) [[unlikely]]
+        return result;
+
+    JournalRecord record{};
+    record.order_id = incoming.id;
+    record.result = result;
+    record.price = incoming.price;
+    record.quantity = incoming.quantity;
+    record.op = JournalOp::MATCH;
+    record.side = incoming.side;
+    record.participant = participant;
+    journal.append(record);
+    return result;
+}
+
+uint32_t journaled_match_iceberg(Journal &journal, Orderbook &orderbook,
+                                 const Order &incoming,
+                                 QuantityType display_quantity,
+                                 ParticipantType participant) noexcept {
+    const uint32_t result =
+        match_iceberg_as(orderbook, incoming, display_quantity, participant);
+    if (result == RISK_REJECTED) [[unlikely]]
+        return result;
+
+    JournalRecord record{};
+    record.order_id = incoming.id;
+    record.result = result;
+    record.price = incoming.price;
+    record.quantity = incoming.quantity;
+    record.display = display_quantity;
+    record.op = JournalOp::ICEBERG;
+    record.side = incoming.side;
+    record.participant = participant;
+    journal.append(record);
+    return result;
+}
+
+void journaled_modify_order_by_id(Journal &journal, Orderbook &orderbook,
+                                  IdType order_id,
+                                  QuantityType new_quantity) noexcept {
+    if (!orderbook._order_quantities[order_id]) [[unlikely]]
+        return;
+    modify_order_by_id(orderbook, order_id, new_quantity);
+
+    JournalRecord record{};
+    record.order_id = order_id;
+    record.quantity = new_quantity;
+    record.op = JournalOp::MODIFY;
+    journal.append(record);
+}
+
+void journaled_begin_auction(Journal &journal, Orderbook &orderbook) noexcept {
+    begin_auction(orderbook);
+
+    JournalRecord record{};
+    record.op = JournalOp::BEGIN_AUCTION;
+    journal.append(record);
+}
+
+uint32_t journaled_uncross(Journal &journal, Orderbook &orderbook) noexcept {
+    const uint32_t result = uncross(orderbook);
+
+    JournalRecord record{};
+    record.result = result;
+    record.op = JournalOp::UNCROSS;
+    journal.append(record);
+    return result;
+}
+
+void journaled_set_risk_limits(Journal &journal, Orderbook &orderbook,
+                               ParticipantType participant,
+                               const RiskLimits &limits) noexcept {
+    set_risk_limits(orderbook, participant, limits);
+
+    JournalRecord record{};
+    record.order_id = limits.max_order_notional;
+    record.result = limits.max_position;
+    record.price = limits.price_band;
+    record.quantity = limits.max_order_quantity;
+    record.op = JournalOp::SET_RISK_LIMITS;
+    record.participant = participant;
+    journal.append(record);
+}
+
+void journaled_set_self_trade_mode(Journal &journal, Orderbook &orderbook,
+                                   ParticipantType participant,
+                                   SelfTradeMode mode) noexcept {
+    set_self_trade_mode(orderbook, participant, mode);
+
+    JournalRecord record{};
+    record.op = JournalOp::SET_SELF_TRADE_MODE;
+    record.participant = participant;
+    record.mode = mode;
+    journal.append(record);
+}
+
+// Functions below here don't need to be performant
+uint64_t replay_journal(const char *path, Orderbook &orderbook) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Cannot open journal");
+
+    JournalRecord batch[256];
+    uint64_t last = 0;
+    off_t offset = 0;
+    for (;;) {
+        const ssize_t n = pread(fd, batch, sizeof(batch), offset);
+        if (n < 0) {
+            close(fd);
+            throw std::runtime_error("Cannot read journal");
+        }
+        // A trailing partial record is an interrupted write; stop there
+        const std::size_t count = n / sizeof(JournalRecord);
+        if (!count)
+            break;
+        offset += count * sizeof(JournalRecord);
+
+        for (std::size_t i = 0; i < count; ++i) {
+            const JournalRecord &r = batch[i];
+            if (r.checksum != record_checksum(r) || r.sequence <= last) {
+                close(fd);
+                throw std::runtime_error("Corrupt journal record");
+            }
+            last = r.sequence;
+
+            uint32_t result;
+            switch (r.op) {
+            case JournalOp::MODIFY:
+                modify_order_by_id(orderbook, r.order_id, r.quantity);
+                continue;
+            case JournalOp::BEGIN_AUCTION:
+                begin_auction(orderbook);
+                continue;
+            case JournalOp::SET_RISK_LIMITS:
+                set_risk_limits(orderbook, r.participant,
+                                RiskLimits{r.quantity, r.price, r.order_id,
+                                           r.result});
+                continue;
+            case JournalOp::SET_SELF_TRADE_MODE:
+                set_self_trade_mode(orderbook, r.participant, r.mode);
+                continue;
+            case JournalOp::UNCROSS:
+                result = uncross(orderbook);
+                break;
+            case JournalOp::ICEBERG:
+                result = match_iceberg_as(
+                    orderbook, Order{r.order_id, r.price, r.quantity, r.side},
+                    r.display, r.participant);
+                break;
+            default:
+                result = match_order_as(
+                    orderbook, Order{r.order_id, r.price, r.quantity, r.side},
+                    r.participant);
+            }
+            if (result != r.result) {
+                close(fd);
+                throw std::runtime_error("Journal does not replay");
+            }
+        }
+    }
+    close(fd);
+    return last;
+}
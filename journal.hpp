@@ -0,0 +1,137 @@
+#pragma once
+
+#include "engine.hpp"
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+/*
+Append-only event journal with group commit.
+
+The engine thread appends one fixed-size record per accepted operation into
+a lock-free ring and never blocks on I/O. A writer thread drains the ring in
+batches with pwritev and calls fdatasync at most once per commit interval,
+then publishes the highest sequence number that is on disk. Callers that
+need an acknowledgement wait on durable_sequence() for their record's
+sequence.
+
+Records hold the operation's inputs and its result, and every change to the
+risk limits or self-trade modes. The engine is deterministic, so replaying
+them in order into a fresh create_orderbook() reproduces every fill; the
+recorded match counts are checked along the way.
+*/
+
+enum class JournalOp : uint8_t {
+    MATCH,
+    MODIFY,
+    BEGIN_AUCTION,
+    UNCROSS,
+    ICEBERG,
+    SET_RISK_LIMITS,
+    SET_SELF_TRADE_MODE,
+};
+
+// SET_RISK_LIMITS reuses the order fields for the limits, as commented
+struct JournalRecord {
+    uint64_t sequence;
+    IdType order_id; // max_order_notional
+    uint32_t result; // match_order_as / uncross return value; max_position
+    PriceType price;       // price_band
+    QuantityType quantity; // max_order_quantity
+    QuantityType display;  // ICEBERG only
+    JournalOp op;
+    Side side;
+    ParticipantType participant;
+    SelfTradeMode mode; // SET_SELF_TRADE_MODE only
+    uint8_t reserved[2];
+    uint32_t checksum; // over the bytes above, catches torn writes
+};
+static_assert(sizeof(JournalRecord) == 32, "records are written raw");
+
+class Journal {
+  public:
+    static constexpr std::size_t RING_CAPACITY = 1 << 16;
+    // Most whole records a crash can leave unsynced after the last good one
+    static constexpr std::size_t MAX_TORN_RECORDS = RING_CAPACITY;
+
+    // Opens (or creates) the journal at `path`, drops a torn tail of at most
+    // MAX_TORN_RECORDS records after the last one that checks out, and
+    // starts the writer thread. Sequence numbers continue from the last
+    // record on disk. Throws std::runtime_error on failure, and without
+    // changing the file if it holds bytes but no valid record near its end
+    // (not a journal, or an older record layout).
+    Journal(const char *path, std::chrono::microseconds commit_interval);
+    // Drains the ring, syncs and stops the writer
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    // Engine thread only. Stamps the sequence number and checksum and
+    // enqueues the record, spinning if the writer has fallen RING_CAPACITY
+    // records behind. Returns the record's sequence number.
+    uint64_t append(JournalRecord record) noexcept;
+
+    // Highest sequence number known to be on stable storage
+    uint64_t durable_sequence() const noexcept {
+        return durable_.load(std::memory_order_acquire);
+    }
+    // Blocks until `sequence` is durable. Returns false if the writer hit an
+    // I/O error first.
+    bool wait_durable(uint64_t sequence) const noexcept;
+
+    bool failed() const noexcept {
+        return failed_.load(std::memory_order_acquire);
+    }
+
+  private:
+    void writer_loop();
+
+    int fd_ = -1;
+    off_t offset_ = 0; // writer thread only after construction
+    uint64_t next_sequence_ = 1;
+    std::chrono::microseconds commit_interval_;
+
+    alignas(64) std::atomic<uint64_t> durable_{0};
+    std::atomic<bool> failed_{false};
+    std::atomic<bool> stop_{false};
+
+    SpscRing<JournalRecord, RING_CAPACITY> ring_;
+    std::thread writer_;
+};
+
+// match_order_as / match_iceberg_as / modify_order_by_id, journaled. Only
+// accepted operations are recorded: risk rejects and modifies of unknown
+// orders are not.
+uint32_t journaled_match_order(Journal &journal, Orderbook &orderbook,
+                               const Order &incoming,
+                               ParticipantType participant = 0) noexcept;
+uint32_t journaled_match_iceberg(Journal &journal, Orderbook &orderbook,
+                                 const Order &incoming,
+                                 QuantityType display_quantity,
+                                 ParticipantType participant = 0) noexcept;
+void journaled_modify_order_by_id(Journal &journal, Orderbook &orderbook,
+                                  IdType order_id,
+                                  QuantityType new_quantity) noexcept;
+// begin_auction / uncross, journaled. Orders accepted during the auction
+// only rest, so without these records replay would match them on arrival.
+void journaled_begin_auction(Journal &journal, Orderbook &orderbook) noexcept;
+uint32_t journaled_uncross(Journal &journal, Orderbook &orderbook) noexcept;
+// set_risk_limits / set_self_trade_mode, journaled. They change what later
+// orders do, so replay needs them in sequence with the orders.
+void journaled_set_risk_limits(Journal &journal, Orderbook &orderbook,
+                               ParticipantType participant,
+                               const RiskLimits &limits) noexcept;
+void journaled_set_self_trade_mode(Journal &journal, Orderbook &orderbook,
+                                   ParticipantType participant,
+                                   SelfTradeMode mode) noexcept;
+
+// Re-applies every complete record in `path` to `orderbook` (normally a
+// fresh create_orderbook(), configured as the live book was when the journal
+// was first opened). Returns the last sequence applied. Throws
+// std::runtime_error on a corrupt record or a result that does not replay.
+uint64_t replay_journal(const char *path, Orderbook &orderbook);
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+One FIFO queue per price level, with the queue storage carved on demand from
+a pool of fixed-size blocks. A level holds a block only while it has entries
+and gives it back when it empties, so the memory touched follows the number
+of live levels rather than the price range.
+
+Each level's header can carry a small Payload (the book keeps the level's
+volume there), so everything an add or a fill updates for a level besides
+the queue entry itself sits in one header on one cache line.
+
+Levels refer to their block by index, never by pointer, so the whole
+structure stays valid when mapped at a different address (shared memory).
+Freed blocks are reused LIFO to keep the working set hot, and blocks that
+were never handed out are never written, so their pages are never faulted in.
+*/
+struct NoPayload {};
+
+template <typename T, uint32_t Slots, uint32_t Levels,
+          typename Payload = NoPayload>
+class LevelQueues {
+    static_assert(Slots > 0 && (Slots & (Slots - 1)) == 0 && Slots <= 128,
+                  "Slots must be a power of two that fits the 8-bit count");
+    static_assert(Levels < UINT16_MAX, "Block indices are 16-bit");
+
+    using BlockIndex = uint16_t;
+    static constexpr uint32_t MASK = Slots - 1;
+
+    // Block 0 is never handed out: it marks a level without storage
+    struct Level {
+        BlockIndex block;
+        uint8_t tail;
+        uint8_t count;
+        [[no_unique_address]] Payload payload;
+    };
+    struct alignas(64) Block {
+        std::array<T, Slots> items;
+    };
+
+    std::array<Level, Levels> levels_{};
+    std::array<BlockIndex, Levels> free_{};
+    uint32_t free_count_ = 0;
+    uint32_t next_unused_ = 1;
+    // Deliberately left uninitialised (see the constructor). Each level owns
+    // at most one block, so Levels + 1 blocks can never run out.
+    std::array<Block, Levels + 1> blocks_;
+
+  public:
+    // User-provided so that value-initialising the owner does not zero (and
+    // fault in) the whole pool. Only the sentinel block is cleared: peek()
+    // on an empty level reads it.
+    LevelQueues() noexcept { blocks_[0].items.fill(T{}); }
+
+    // Non-owning view of one level's queue. Cheap to copy, only valid while
+    // the LevelQueues it came from is.
+    class Queue {
+        LevelQueues &queues_;
+        Level &level_;
+
+      public:
+        Queue(LevelQueues &queues, Level &level) noexcept
+            : queues_(queues), level_(level) {}
+
+        inline __attribute__((always_inline, hot)) T front() const {
+            return queues_.blocks_[level_.block].items[level_.tail];
+        }
+        inline __attribute__((always_inline, hot)) uint32_t size() const {
+            return level_.count;
+        }
+        // Ring slot of the front item; item k sits at (front_slot() + k)
+        // modulo Slots
+        inline uint32_t front_slot() const { return level_.tail; }
+        // Item `ahead` (< Slots) places behind the front, for prefetching.
+        // Not checked against size(), so past the back it returns a stale
+        // (but in-range) item instead of branching.
+        inline __attribute__((always_inline, hot)) T peek(uint32_t ahead) const {
+            return queues_.blocks_[level_.block]
+                .items[(level_.tail + ahead) & MASK];
+        }
+        inline __attribute__((always_inline, hot)) bool empty() const {
+            return level_.count == 0;
+        }
+        inline __attribute__((always_inline, hot)) bool full() const {
+            return level_.count == Slots;
+        }
+        inline __attribute__((always_inline, hot)) bool push_back(T item) {
+            if (full()) {
+                return false;
+            }
+            if (level_.block == 0) [[unlikely]]
+                level_.block = queues_.acquire();
+            queues_.blocks_[level_.block]
+                .items[(level_.tail + level_.count) & MASK] = item;
+            ++level_.count;
+            return true;
+        }
+        inline __attribute__((always_inline, hot)) void pop_front() {
+            level_.tail = (level_.tail + 1) & MASK;
+            if (--level_.count == 0) [[unlikely]] {
+                queues_.release(level_.block);
+                level_.block = 0;
+                level_.tail = 0;
+            }
+        }
+    };
+
+    inline __attribute__((always_inline, hot)) Queue operator[](size_t level) {
+        return Queue(*this, levels_[level]);
+    }
+
+    inline __attribute__((always_inline, hot)) Payload &
+    payload(size_t level) {
+        return levels_[level].payload;
+    }
+    inline __attribute__((always_inline, hot)) const Payload &
+    payload(size_t level) const {
+        return levels_[level].payload;
+    }
+    // Bytes per level header; headers are contiguous from the first line
+    static constexpr std::size_t HEADER_SIZE = sizeof(Level);
+
+    // Items queued at `level`
+    inline uint32_t size(size_t level) const { return levels_[level].count; }
+
+    // Whether ring slot `slot` of `level` is occupied, and by `item`
+    inline bool holds(size_t level, uint32_t slot, T item) const {
+        const Level &l = levels_[level];
+        return ((slot - l.tail) & MASK) < l.count &&
+               blocks_[l.block].items[slot & MASK] == item;
+    }
+
+    // Cache hints: a level's header and its block are separate lines, so
+    // warming front() from cold takes two dependent steps
+    inline void prefetch_level(size_t level) const {
+        __builtin_prefetch(&levels_[level]);
+    }
+    inline void prefetch_front(size_t level) const {
+        const Level &l = levels_[level];
+        __builtin_prefetch(&blocks_[l.block].items[l.tail]);
+    }
+
+    // Blocks currently held by levels
+    uint32_t blocks_in_use() const { return next_unused_ - 1 - free_count_; }
+    // Blocks ever handed out, i.e. the pool's touched footprint
+    uint32_t blocks_touched() const { return next_unused_ - 1; }
+
+  private:
+    inline BlockIndex acquire() noexcept {
+        if (free_count_)
+            return free_[--free_count_];
+        // First use of this block: clear it so stale peeks stay in range
+        blocks_[next_unused_].items.fill(T{});
+        return static_cast<BlockIndex>(next_unused_++);
+    }
+    inline void release(BlockIndex block) noexcept {
+        free_[free_count_++] = block;
+    }
+};
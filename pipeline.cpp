@@ -0,0 +1,204 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+#include <pthread.h>
+#include <sched.h>
+
+void pin_current_thread(int cpu) noexcept {
+    if (cpu < 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+using PipelineRing = SpscRing<PipelineSlot, Pipeline::RING_CAPACITY>;
+
+// Slot type of a set_risk_limits() call on its way down the rings. Never
+// valid on the wire, and never published. The limits ride in the response.
+static constexpr WireType SET_RISK_LIMITS = static_cast<WireType>(0x80);
+static_assert(sizeof(RiskLimits) <= sizeof(WireResponse));
+
+static RiskLimits slot_limits(const PipelineSlot &slot) noexcept {
+    RiskLimits limits;
+    std::memcpy(&limits, &slot.response, sizeof(limits));
+    return limits;
+}
+
+// Spins briefly, then yields, so a waiting stage does not starve the others
+// when stages share a core
+struct Backoff {
+    uint32_t spins = 0;
+
+    void wait() noexcept {
+        if (spins < 64) {
+            ++spins;
+            _mm_pause();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+};
+
+// Hands slots[0, count) to `ring`, waiting while it is full
+static void push_all(PipelineRing &ring, const PipelineSlot *slots,
+                     std::size_t count) noexcept {
+    Backoff full;
+    while (count) {
+        const std::size_t pushed = ring.try_push_some(slots, count);
+        slots += pushed;
+        count -= pushed;
+        if (count) [[unlikely]]
+            full.wait();
+    }
+}
+
+// The loop every worker stage runs: take up to MAX_BATCH slots from `in`,
+// let `fn` work on them, pass them to `out` (if any). Returns once `stop`
+// is set and `in` is empty.
+template <typename Fn>
+static void run_stage(PipelineRing &in, PipelineRing *out,
+                      const std::atomic<bool> &stop, Fn &&fn) noexcept {
+    PipelineSlot batch[Pipeline::MAX_BATCH];
+    Backoff idle;
+    for (;;) {
+        const PipelineRing::Runs runs = in.readable();
+        if (!runs.first_count) {
+            if (stop.load(std::memory_order_acquire))
+                return;
+            idle.wait();
+            continue;
+        }
+        idle.spins = 0;
+
+        const std::size_t count =
+            std::min(runs.first_count, Pipeline::MAX_BATCH);
+        std::copy_n(runs.first, count, batch);
+        in.consume(count);
+        fn(batch, count);
+        if (out)
+            push_all(*out, batch, count);
+    }
+}
+
+Pipeline::Pipeline(Orderbook &orderbook, Sink sink, void *context, Cpus cpus)
+    : book_(orderbook), sink_(sink), context_(context),
+      limits_(orderbook._risk) {
+    risk_ = std::thread([this, cpu = cpus.risk] { risk_loop(cpu); });
+    match_ = std::thread([this, cpu = cpus.match] { match_loop(cpu); });
+    publish_ = std::thread([this, cpu = cpus.publish] { publish_loop(cpu); });
+}
+
+Pipeline::~Pipeline() {
+    drain();
+    stop_.store(true, std::memory_order_release);
+    risk_.join();
+    match_.join();
+    publish_.join();
+}
+
+void Pipeline::submit(const WireRequest *requests,
+                      std::size_t count) noexcept {
+    PipelineSlot batch[MAX_BATCH];
+    submitted_ += count;
+    while (count) {
+        const std::size_t n = std::min(count, MAX_BATCH);
+        for (std::size_t i = 0; i < n; ++i) {
+            PipelineSlot &slot = batch[i];
+            slot.request = requests[i];
+            slot.response = WireResponse{
+                sizeof(WireResponse), slot.request.type, WireStatus::ACCEPTED,
+                slot.request.order_id, 0, sequence_++};
+            if (!wire_request_valid(slot.request)) [[unlikely]]
+                slot.response.status = WireStatus::MALFORMED;
+        }
+        push_all(parsed_, batch, n);
+        requests += n;
+        count -= n;
+    }
+}
+
+void Pipeline::set_risk_limits(ParticipantType participant,
+                               const RiskLimits &limits) noexcept {
+    PipelineSlot slot{};
+    slot.request.type = SET_RISK_LIMITS;
+    slot.request.participant = participant;
+    std::memcpy(&slot.response, &limits, sizeof(limits));
+    push_all(parsed_, &slot, 1);
+}
+
+void Pipeline::drain() const noexcept {
+    Backoff pending;
+    while (published_.load(std::memory_order_acquire) != submitted_)
+        pending.wait();
+}
+
+void Pipeline::risk_loop(int cpu) noexcept {
+    pin_current_thread(cpu);
+    run_stage(parsed_, &checked_, stop_,
+              [this](PipelineSlot *slots, std::size_t count) {
+                  if constexpr (!RISK_CHECKS)
+                      return;
+                  for (std::size_t i = 0; i < count; ++i) {
+                      const WireRequest &request = slots[i].request;
+                      if (request.type == SET_RISK_LIMITS) [[unlikely]] {
+                          limits_[request.participant].configure(
+                              slot_limits(slots[i]));
+                          continue;
+                      }
+                      if (slots[i].response.status != WireStatus::ACCEPTED ||
+                          request.type != WireType::NEW_ORDER)
+                          continue;
+                      const RiskState &limits = limits_[request.participant];
+                      const uint32_t notional =
+                          static_cast<uint32_t>(request.price) *
+                          request.quantity;
+                      if ((request.quantity > limits.max_order_quantity) |
+                          (notional > limits.max_order_notional))
+                          [[unlikely]]
+                          slots[i].response.status = WireStatus::RISK_REJECTED;
+                  }
+              });
+}
+
+void Pipeline::match_loop(int cpu) noexcept {
+    pin_current_thread(cpu);
+    run_stage(checked_, &matched_, stop_,
+              [this](PipelineSlot *slots, std::size_t count) {
+                  for (std::size_t i = 0; i < count; ++i) {
+                      if (i + 1 < count) [[likely]]
+                          __builtin_prefetch(
+                              &book_._order_quantities
+                                   [slots[i + 1].request.order_id %
+                                    MAX_ORDERS]);
+                      const WireRequest &request = slots[i].request;
+                      if (request.type == SET_RISK_LIMITS) [[unlikely]]
+                          ::set_risk_limits(book_, request.participant,
+                                            slot_limits(slots[i]));
+                      else if (slots[i].response.status ==
+                               WireStatus::ACCEPTED)
+                          gateway_detail::apply_prechecked_wire_request(
+                              book_, request, slots[i].response);
+                  }
+              });
+}
+
+void Pipeline::publish_loop(int cpu) noexcept {
+    pin_current_thread(cpu);
+    run_stage(matched_, nullptr, stop_,
+              [this](PipelineSlot *slots, std::size_t count) {
+                  WireResponse responses[MAX_BATCH];
+                  std::size_t n = 0;
+                  for (std::size_t i = 0; i < count; ++i)
+                      if (slots[i].request.type != SET_RISK_LIMITS) [[likely]]
+                          responses[n++] = slots[i].response;
+                  if (n)
+                      sink_(responses, n, context_);
+                  published_.store(
+                      published_.load(std::memory_order_relaxed) + n,
+                      std::memory_order_release);
+              });
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "engine.hpp"
+#include "gateway.hpp"
+#include "spsc_ring.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+/*
+Staged order pipeline around one Orderbook: parse -> risk -> match ->
+publish, each stage on its own thread and connected by SPSC rings.
+
+- parse (the thread calling submit()): field checks, as the gateway does
+- risk: the limits that do not depend on the book (order quantity and
+  notional), against its own copy of the book's limits. Position and price
+  band depend on fills and on the book, so they stay in the engine
+- match: the only thread that touches the Orderbook. It goes through the
+  engine's internal prechecked entry, so orders are not checked a second
+  time for what the risk stage already checked
+
+Limits change through set_risk_limits(), which travels down the rings like
+a request: the risk stage updates its copy and the match stage the book's
+when they reach it, so both apply it between the same two requests.
+- publish: hands batches of responses to the sink, so the publishing and
+  journaling work the sink does never delays the next match
+
+Each stage takes everything readable from its input (up to MAX_BATCH) and
+passes it on with one release of the next ring's head. A stage whose output
+ring is full waits for it, which pushes the backpressure up to submit().
+Every stage is FIFO and only the match stage changes state, so responses
+come out in submission order and are identical to Gateway::handle() on the
+same requests.
+*/
+
+// One request on its way through the stages, with its response filled in
+// as it goes. Two per cache line.
+struct PipelineSlot {
+    WireRequest request;
+    WireResponse response;
+};
+static_assert(sizeof(PipelineSlot) == 32, "two slots per cache line");
+
+// Pins the calling thread to `cpu`; a negative cpu leaves it unpinned
+void pin_current_thread(int cpu) noexcept;
+
+class Pipeline {
+  public:
+    static constexpr std::size_t RING_CAPACITY = 1 << 12;
+    static constexpr std::size_t MAX_BATCH = 64; // slots per hand-off
+
+    // Runs on the publish thread with responses in submission order. A
+    // single thread, so it may append to a Journal.
+    using Sink = void (*)(const WireResponse *responses, std::size_t count,
+                          void *context);
+
+    // CPUs for the worker stages; -1 leaves a stage unpinned. The parse
+    // stage runs on whichever thread calls submit().
+    struct Cpus {
+        int risk = -1;
+        int match = -1;
+        int publish = -1;
+    };
+
+    // Copies the risk limits set on `orderbook` and starts the risk, match
+    // and publish threads. From here until destruction only the match
+    // thread may touch the book; change limits with set_risk_limits().
+    Pipeline(Orderbook &orderbook, Sink sink, void *context, Cpus cpus);
+    // Publishes everything submitted, then stops the threads
+    ~Pipeline();
+
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    // Parse stage. Checks requests[0, count) and hands them to the risk
+    // stage in batches, waiting while its ring is full. One thread only.
+    void submit(const WireRequest *requests, std::size_t count) noexcept;
+
+    // set_risk_limits on the book, for every request submitted after this
+    // call and none before. From the submitting thread.
+    void set_risk_limits(ParticipantType participant,
+                         const RiskLimits &limits) noexcept;
+
+    // Waits until everything submitted so far has been published. From the
+    // submitting thread.
+    void drain() const noexcept;
+
+  private:
+    using Ring = SpscRing<PipelineSlot, RING_CAPACITY>;
+
+    void risk_loop(int cpu) noexcept;
+    void match_loop(int cpu) noexcept;
+    void publish_loop(int cpu) noexcept;
+
+    Orderbook &book_;
+    Sink sink_;
+    void *context_;
+    uint32_t sequence_ = 0;  // parse stage only
+    uint64_t submitted_ = 0; // parse stage only
+    std::array<RiskState, MAX_PARTICIPANTS> limits_; // risk stage only
+
+    alignas(64) std::atomic<uint64_t> published_{0};
+    std::atomic<bool> stop_{false};
+
+    Ring parsed_;  // parse -> risk
+    Ring checked_; // risk -> match
+    Ring matched_; // match -> publish
+
+    std::thread risk_;
+    std::thread match_;
+    std::thread publish_;
+};
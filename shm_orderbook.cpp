@@ -0,0 +1,217 @@
+#include "shm_orderbook.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Writer: odd sequence = write in progress. Only one writer exists, so the
+// sequence is read back with a relaxed load.
+static inline __attribute__((always_inline)) void
+begin_write(SharedOrderbook &shared) noexcept {
+    shared._seq.store(shared._seq.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+static inline __attribute__((always_inline)) void
+end_write(SharedOrderbook &shared) noexcept {
+    shared._seq.store(shared._seq.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_release);
+}
+
+uint32_t shared_match_order(SharedOrderbook &shared,
+                            const Order &incoming) noexcept {
+    begin_write(shared);
+    const uint32_t match_count = match_order(shared._book, incoming);
+    end_write(shared);
+    return match_count;
+}
+
+void shared_modify_order_by_id(SharedOrderbook &shared, IdType order_id,
+                               QuantityType new_quantity) noexcept {
+    begin_write(shared);
+    modify_order_by_id(shared._book, order_id, new_quantity);
+    end_write(shared);
+}
+
+uint32_t shared_match_order_as(SharedOrderbook &shared, const Order &incoming,
+                               ParticipantType participant) noexcept {
+    begin_write(shared);
+    const uint32_t match_count =
+        match_order_as(shared._book, incoming, participant);
+    end_write(shared);
+    return match_count;
+}
+
+uint32_t shared_match_iceberg_as(SharedOrderbook &shared,
+                                 const Order &incoming,
+                                 QuantityType display_quantity,
+                                 ParticipantType participant) noexcept {
+    begin_write(shared);
+    const uint32_t match_count = match_iceberg_as(
+        shared._book, incoming, display_quantity, participant);
+    end_write(shared);
+    return match_count;
+}
+
+void shared_begin_auction(SharedOrderbook &shared) noexcept {
+    begin_write(shared);
+    begin_auction(shared._book);
+    end_write(shared);
+}
+
+uint32_t shared_uncross(SharedOrderbook &shared) noexcept {
+    begin_write(shared);
+    const uint32_t match_count = uncross(shared._book);
+    end_write(shared);
+    return match_count;
+}
+
+void shared_set_self_trade_mode(SharedOrderbook &shared,
+                                ParticipantType participant,
+                                SelfTradeMode mode) noexcept {
+    begin_write(shared);
+    set_self_trade_mode(shared._book, participant, mode);
+    end_write(shared);
+}
+
+void shared_set_risk_limits(SharedOrderbook &shared,
+                            ParticipantType participant,
+                            const RiskLimits &limits) noexcept {
+    begin_write(shared);
+    set_risk_limits(shared._book, participant, limits);
+    end_write(shared);
+}
+
+// Reader: the writer may be mid-update, so every book field is read with a
+// relaxed atomic load and the copy is only kept if the sequence did not
+// move. Returns the sequence value the copy is consistent with.
+template <typename Copy>
+static uint64_t read_consistent(const SharedOrderbook &shared,
+                                Copy &&copy) noexcept {
+    for (;;) {
+        const uint64_t before = shared._seq.load(std::memory_order_acquire);
+        if (before & 1) [[unlikely]] {
+            _mm_pause();
+            continue;
+        }
+        copy();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (shared._seq.load(std::memory_order_relaxed) == before) [[likely]]
+            return before;
+    }
+}
+
+static inline __attribute__((always_inline)) VolumeType
+load_relaxed(const VolumeType &value) noexcept {
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+// Finds the most competitive level with volume by scanning the depth index
+// from the competitive end. Only volumes are read, so a torn read can give
+// a wrong answer (discarded by the retry) but never an out-of-range index.
+static bool find_best(const OBSide &levels, Side side, PriceType &price,
+                      VolumeType &volume) noexcept {
+    const VolumeBlocks &blocks = levels.volume_blocks();
+
+    if (side == Side::BUY) {
+        for (size_t b = NUM_VOLUME_BLOCKS; b-- > 0;) {
+            if (!load_relaxed(blocks[b]))
+                continue;
+            const size_t lo = b * VOLUME_BLOCK_SIZE;
+            for (size_t i = lo + VOLUME_BLOCK_SIZE; i-- > lo;) {
+                if ((volume = load_relaxed(levels.volume_at(i)))) {
+                    price = static_cast<PriceType>(i + BASE_PRICE);
+                    return true;
+                }
+            }
+        }
+    } else {
+        for (size_t b = 0; b < NUM_VOLUME_BLOCKS; ++b) {
+            if (!load_relaxed(blocks[b]))
+                continue;
+            const size_t lo = b * VOLUME_BLOCK_SIZE;
+            for (size_t i = lo; i < lo + VOLUME_BLOCK_SIZE; ++i) {
+                if ((volume = load_relaxed(levels.volume_at(i)))) {
+                    price = static_cast<PriceType>(i + BASE_PRICE);
+                    return true;
+                }
+            }
+        }
+    }
+    price = 0;
+    volume = 0;
+    return false;
+}
+
+BookTop read_book_top(const SharedOrderbook &shared) noexcept {
+    BookTop top{};
+    const Orderbook &book = shared._book;
+    top.version = read_consistent(shared, [&] {
+        top.has_bid = find_best(book._levels[0], Side::BUY, top.bid_price,
+                                top.bid_volume);
+        top.has_ask = find_best(book._levels[1], Side::SELL, top.ask_price,
+                                top.ask_volume);
+    });
+    return top;
+}
+
+uint64_t read_level_volumes(const SharedOrderbook &shared, Side side,
+                            PriceType price, uint32_t count,
+                            VolumeType *out) noexcept {
+    const OBSide &levels = shared._book._levels[static_cast<size_t>(side)];
+    const size_t first = price - BASE_PRICE;
+    return read_consistent(shared, [&] {
+        for (uint32_t i = 0; i < count; ++i)
+            out[i] = first + i < MAX_NUM_PRICES
+                         ? load_relaxed(levels.volume_at(first + i))
+                         : 0;
+    });
+}
+
+// Functions below here set up and tear down mappings; they make syscalls
+// and are not meant for the hot path
+SharedOrderbook *create_shared_orderbook(const char *name) {
+    const int fd = shm_open(name, O_CREAT | O_RDWR, 0600);
+    if (fd < 0)
+        return nullptr;
+
+    if (ftruncate(fd, sizeof(SharedOrderbook)) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, sizeof(SharedOrderbook), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return nullptr;
+
+    return new (addr) SharedOrderbook;
+}
+
+const SharedOrderbook *open_shared_orderbook(const char *name) {
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return nullptr;
+
+    void *addr =
+        mmap(nullptr, sizeof(SharedOrderbook), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return nullptr;
+
+    return static_cast<const SharedOrderbook *>(addr);
+}
+
+void close_shared_orderbook(const SharedOrderbook *shared) {
+    munmap(const_cast<SharedOrderbook *>(shared), sizeof(SharedOrderbook));
+}
+
+bool unlink_shared_orderbook(const char *name) {
+    return shm_unlink(name) == 0;
+}
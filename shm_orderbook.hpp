@@ -0,0 +1,86 @@
+#pragma once
+
+#include "engine.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+/*
+An Orderbook placed in a named POSIX shared-memory segment, for a single
+matching (writer) process and any number of reader processes.
+
+The writer goes through the shared_* wrappers, one for every public engine
+call that changes the book (orders, modifies, auctions and the per-slot risk
+and self-trade configuration). Each brackets the call with a seqlock: the
+sequence number is odd while a write is in progress and bumped to the next
+even value when it is done. Readers copy what they need, then retry if the sequence moved or was
+odd, so every snapshot they return was a consistent book state. Neither
+side takes a lock or makes a syscall after the segment is mapped.
+
+Orderbook holds no pointers (only fixed arrays and indices), so it can be
+mapped at a different address in every process.
+*/
+struct SharedOrderbook {
+    alignas(64) std::atomic<uint64_t> _seq{0};
+    alignas(64) Orderbook _book{};
+};
+
+// Top of book as seen by a reader. A missing side has price and volume 0.
+struct BookTop {
+    uint64_t version; // seqlock value the snapshot was taken at
+    PriceType bid_price;
+    PriceType ask_price;
+    VolumeType bid_volume;
+    VolumeType ask_volume;
+    bool has_bid;
+    bool has_ask;
+};
+
+extern "C" {
+// Writer side. Creates the segment `name` (e.g. "/book-1"), or reuses an
+// existing one, and constructs an empty book in it over whatever it held.
+// Returns nullptr on failure.
+SharedOrderbook *create_shared_orderbook(const char *name);
+
+// Same as match_order / modify_order_by_id, published through the seqlock
+uint32_t shared_match_order(SharedOrderbook &shared,
+                            const Order &incoming) noexcept;
+void shared_modify_order_by_id(SharedOrderbook &shared, IdType order_id,
+                               QuantityType new_quantity) noexcept;
+// Same as match_order_as / match_iceberg_as / begin_auction / uncross /
+// set_self_trade_mode / set_risk_limits. A book that readers map must only
+// be changed through these wrappers.
+uint32_t shared_match_order_as(SharedOrderbook &shared, const Order &incoming,
+                               ParticipantType participant) noexcept;
+uint32_t shared_match_iceberg_as(SharedOrderbook &shared,
+                                 const Order &incoming,
+                                 QuantityType display_quantity,
+                                 ParticipantType participant) noexcept;
+void shared_begin_auction(SharedOrderbook &shared) noexcept;
+uint32_t shared_uncross(SharedOrderbook &shared) noexcept;
+void shared_set_self_trade_mode(SharedOrderbook &shared,
+                                ParticipantType participant,
+                                SelfTradeMode mode) noexcept;
+void shared_set_risk_limits(SharedOrderbook &shared,
+                            ParticipantType participant,
+                            const RiskLimits &limits) noexcept;
+
+// Reader side. Maps an existing segment read-only. Returns nullptr on
+// failure.
+const SharedOrderbook *open_shared_orderbook(const char *name);
+
+// Consistent best bid/ask and the volume resting at each
+BookTop read_book_top(const SharedOrderbook &shared) noexcept;
+
+// Consistent copy of `count` level volumes of `side` starting at `price`
+// into `out`. Returns the seqlock version the copy was taken at.
+uint64_t read_level_volumes(const SharedOrderbook &shared, Side side,
+                            PriceType price, uint32_t count,
+                            VolumeType *out) noexcept;
+
+// Unmaps a segment from this process (either side)
+void close_shared_orderbook(const SharedOrderbook *shared);
+
+// Removes the segment name; existing mappings stay valid
+bool unlink_shared_orderbook(const char *name);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+Lock-free single-producer/single-consumer ring of fixed capacity (a power of
+two). Producer and consumer indices live on separate cache lines, and each
+side keeps a cached copy of the other's index so the shared line is only
+re-read when the ring looks full (producer) or empty (consumer).
+
+The producer can hand over a batch with one release of its index
+(try_push_some), and the consumer can take items in place: readable() exposes the readable items
+as (at most two) contiguous runs and consume() releases them, so batches can
+be handed to e.g. pwritev without a copy.
+*/
+template <typename T, std::size_t Capacity> class SpscRing {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+  private:
+    static constexpr std::size_t MASK = Capacity - 1;
+
+    alignas(64) std::atomic<std::size_t> head_{0}; // next slot to write
+    std::size_t cached_tail_ = 0;                  // producer's view
+    alignas(64) std::atomic<std::size_t> tail_{0}; // next slot to read
+    std::size_t cached_head_ = 0;                  // consumer's view
+    alignas(64) std::array<T, Capacity> items_;
+
+  public:
+    // Producer side
+    inline __attribute__((always_inline, hot)) bool
+    try_push(const T &item) noexcept {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ == Capacity) [[unlikely]] {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ == Capacity)
+                return false;
+        }
+        items_[head & MASK] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side: pushes as many of items[0, count) as fit and publishes
+    // them together. Returns how many were pushed.
+    inline std::size_t try_push_some(const T *items,
+                                     std::size_t count) noexcept {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (Capacity - (head - cached_tail_) < count)
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+        const std::size_t pushed =
+            std::min(count, Capacity - (head - cached_tail_));
+        for (std::size_t i = 0; i < pushed; ++i)
+            items_[(head + i) & MASK] = items[i];
+        if (pushed)
+            head_.store(head + pushed, std::memory_order_release);
+        return pushed;
+    }
+
+    // Consumer side: every readable item, as up to two contiguous runs
+    // (the second is only non-empty when the readable range wraps)
+    struct Runs {
+        const T *first;
+        std::size_t first_count;
+        const T *second;
+        std::size_t second_count;
+
+        std::size_t size() const noexcept { return first_count + second_count; }
+    };
+
+    inline Runs readable() noexcept {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (cached_head_ == tail) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (cached_head_ == tail)
+                return {nullptr, 0, nullptr, 0};
+        }
+        const std::size_t available = cached_head_ - tail;
+        const std::size_t to_end = Capacity - (tail & MASK);
+        if (available <= to_end)
+            return {&items_[tail & MASK], available, nullptr, 0};
+        return {&items_[tail & MASK], to_end, &items_[0], available - to_end};
+    }
+
+    inline void consume(std::size_t count) noexcept {
+        tail_.store(tail_.load(std::memory_order_relaxed) + count,
+                    std::memory_order_release);
+    }
+
+    inline bool try_pop(T &item) noexcept {
+        const Runs runs = readable();
+        if (!runs.first_count)
+            return false;
+        item = *runs.first;
+        consume(1);
+        return true;
+    }
+
+    // Either side; exact only when the other side is idle
+    inline bool empty() const noexcept {
+        return head_.load(std::memory_order_acquire) ==
+               tail_.load(std::memory_order_acquire);
+    }
+};
@@ -1,6 +1,24 @@
+#include "book_scheduler.hpp"
 #include "engine.hpp"
+#include "flight_recorder.hpp"
+#include "gateway.hpp"
+#include "journal.hpp"
+#include "pipeline.hpp"
+#include "shm_orderbook.hpp"
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 // We may add to these later on, but will provide additional tests before the
 // deadline
@@ -715,6 +733,1121 @@ void test_get_volume_all_encompassing() {
   std::cout << "Test 28 passed." << std::endl;
 }
 
+// Test 29: Cumulative volume up to a price, across block boundaries
+void test_volume_up_to_price() {
+  std::cout << "Test 29: Cumulative volume up to a price" << std::endl;
+  Orderbook ob;
+  // Buy levels straddling the 64 and 128 block boundaries.
+  match_order(ob, Order{100, 60, 5, Side::BUY});
+  match_order(ob, Order{101, 64, 7, Side::BUY});
+  match_order(ob, Order{102, 127, 3, Side::BUY});
+  match_order(ob, Order{103, 200, 4, Side::BUY});
+  // Sell levels well above the bids.
+  match_order(ob, Order{104, 300, 10, Side::SELL});
+  match_order(ob, Order{105, 450, 20, Side::SELL});
+
+  assert(get_volume_up_to_price(ob, Side::BUY, 200) == 4);
+  assert(get_volume_up_to_price(ob, Side::BUY, 127) == 7);
+  assert(get_volume_up_to_price(ob, Side::BUY, 64) == 14);
+  assert(get_volume_up_to_price(ob, Side::BUY, 0) == 19);
+  assert(get_volume_up_to_price(ob, Side::SELL, 299) == 0);
+  assert(get_volume_up_to_price(ob, Side::SELL, 300) == 10);
+  assert(get_volume_up_to_price(ob, Side::SELL, 8191) == 30);
+  assert(get_volume_up_to_price(ob, Side::SELL, UINT16_MAX) == 30);
+
+  // Cancels and fills are reflected.
+  modify_order_by_id(ob, 101, 2);
+  match_order(ob, Order{106, 300, 4, Side::BUY});
+  assert(get_volume_up_to_price(ob, Side::BUY, 0) == 14);
+  assert(get_volume_up_to_price(ob, Side::SELL, 8191) == 26);
+
+  std::cout << "Test 29 passed." << std::endl;
+}
+
+// Test 30: Volume within N ticks of the best price
+void test_volume_within_ticks() {
+  std::cout << "Test 30: Volume within N ticks of the best price"
+            << std::endl;
+  Orderbook ob;
+  assert(get_volume_within_ticks(ob, Side::BUY, 10) == 0);
+
+  match_order(ob, Order{110, 100, 5, Side::BUY});
+  match_order(ob, Order{111, 98, 6, Side::BUY});
+  match_order(ob, Order{112, 90, 7, Side::BUY});
+  match_order(ob, Order{113, 101, 1, Side::SELL});
+  match_order(ob, Order{114, 103, 2, Side::SELL});
+  match_order(ob, Order{115, 200, 3, Side::SELL});
+
+  assert(get_volume_within_ticks(ob, Side::BUY, 0) == 5);
+  assert(get_volume_within_ticks(ob, Side::BUY, 2) == 11);
+  assert(get_volume_within_ticks(ob, Side::BUY, 100) == 18);
+  assert(get_volume_within_ticks(ob, Side::SELL, 2) == 3);
+  assert(get_volume_within_ticks(ob, Side::SELL, 99) == 6);
+
+  // The window starts at the best level with volume, not at levels that
+  // lazily cancelled orders leave on the ladder.
+  modify_order_by_id(ob, 110, 0);
+  modify_order_by_id(ob, 111, 0);
+  assert(get_volume_within_ticks(ob, Side::BUY, 2) == 7);
+  modify_order_by_id(ob, 112, 0);
+  assert(get_volume_within_ticks(ob, Side::BUY, 2) == 0);
+
+  std::cout << "Test 30 passed." << std::endl;
+}
+
+// Test 31: Worst price needed to fill a quantity
+void test_price_for_quantity() {
+  std::cout << "Test 31: Worst price needed to fill a quantity" << std::endl;
+  Orderbook ob;
+  PriceType worst = 0;
+  assert(!get_price_for_quantity(ob, Side::SELL, 1, worst));
+
+  match_order(ob, Order{120, 100, 5, Side::SELL});
+  match_order(ob, Order{121, 130, 5, Side::SELL});
+  match_order(ob, Order{122, 300, 5, Side::SELL});
+  match_order(ob, Order{123, 90, 5, Side::BUY});
+  match_order(ob, Order{124, 60, 5, Side::BUY});
+  match_order(ob, Order{125, 2, 5, Side::BUY});
+
+  assert(get_price_for_quantity(ob, Side::SELL, 5, worst) && worst == 100);
+  assert(get_price_for_quantity(ob, Side::SELL, 6, worst) && worst == 130);
+  assert(get_price_for_quantity(ob, Side::SELL, 15, worst) && worst == 300);
+  assert(!get_price_for_quantity(ob, Side::SELL, 16, worst));
+  assert(worst == 300);
+
+  assert(get_price_for_quantity(ob, Side::BUY, 3, worst) && worst == 90);
+  assert(get_price_for_quantity(ob, Side::BUY, 10, worst) && worst == 60);
+  assert(get_price_for_quantity(ob, Side::BUY, 11, worst) && worst == 2);
+  assert(!get_price_for_quantity(ob, Side::BUY, 16, worst));
+
+  // A cancelled best level is skipped over.
+  modify_order_by_id(ob, 120, 0);
+  assert(get_price_for_quantity(ob, Side::SELL, 1, worst) && worst == 130);
+
+  std::cout << "Test 31 passed." << std::endl;
+}
+
+// Test 32: A cancelled order cannot be revived by a later modify
+void test_modify_after_cancel_is_ignored() {
+  std::cout << "Test 32: Modify after cancel is ignored" << std::endl;
+  Orderbook ob;
+  match_order(ob, Order{130, 100, 10, Side::SELL});
+  match_order(ob, Order{131, 100, 4, Side::SELL});
+  modify_order_by_id(ob, 130, 0);
+  modify_order_by_id(ob, 130, 7);
+  assert(!order_exists(ob, 130));
+  assert(get_volume_at_level(ob, Side::SELL, 100) == 4);
+
+  // The cancelled order is skipped when matching.
+  uint32_t matches = match_order(ob, Order{132, 100, 6, Side::BUY});
+  assert(matches == 1);
+  assert(!order_exists(ob, 131));
+  Order order_lookup = lookup_order_by_id(ob, 132);
+  assert(order_lookup.quantity == 2);
+  assert(order_lookup.price == 100);
+  assert(order_lookup.side == Side::BUY);
+
+  std::cout << "Test 32 passed." << std::endl;
+}
+
+// Test 33: Shared-memory book is visible to a reader in another process
+void test_shared_orderbook_reader() {
+  std::cout << "Test 33: Shared-memory book seen by another process"
+            << std::endl;
+  const std::string name = "/lll-test-" + std::to_string(getpid());
+  SharedOrderbook *shared = create_shared_orderbook(name.c_str());
+  assert(shared != nullptr);
+
+  const BookTop empty = read_book_top(*shared);
+  assert(!empty.has_bid && !empty.has_ask);
+
+  shared_match_order(*shared, Order{140, 99, 5, Side::BUY});
+  shared_match_order(*shared, Order{141, 98, 7, Side::BUY});
+  shared_match_order(*shared, Order{142, 101, 3, Side::SELL});
+  shared_match_order(*shared, Order{143, 105, 4, Side::SELL});
+  shared_modify_order_by_id(*shared, 142, 0);
+  // Every write bumps the sequence by two.
+  assert(shared->_seq.load() == 10);
+
+  const pid_t pid = fork();
+  if (pid == 0) {
+    const SharedOrderbook *reader = open_shared_orderbook(name.c_str());
+    if (reader == nullptr)
+      _exit(1);
+    const BookTop top = read_book_top(*reader);
+    VolumeType volumes[4];
+    read_level_volumes(*reader, Side::BUY, 97, 4, volumes);
+    const bool ok = top.has_bid && top.bid_price == 99 &&
+                    top.bid_volume == 5 && top.has_ask &&
+                    top.ask_price == 105 && top.ask_volume == 4 &&
+                    top.version == 10 && volumes[0] == 0 &&
+                    volumes[1] == 7 && volumes[2] == 5 && volumes[3] == 0;
+    close_shared_orderbook(reader);
+    _exit(ok ? 0 : 2);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+  // The other mutators publish through the seqlock too
+  shared_match_order_as(*shared, Order{144, 97, 2, Side::BUY}, 1);
+  shared_begin_auction(*shared);
+  shared_match_iceberg_as(*shared, Order{145, 106, 6, Side::BUY}, 2, 1);
+  assert(shared_uncross(*shared) == 2); // the iceberg replenishes once
+  assert(shared->_seq.load() == 18);
+  const BookTop after = read_book_top(*shared);
+  assert(after.version == 18 && !after.has_ask);
+  assert(after.bid_price == 106 && after.bid_volume == 2);
+  shared_set_self_trade_mode(*shared, 1, SelfTradeMode::CANCEL_RESTING);
+  shared_set_risk_limits(*shared, 1, RiskLimits{10, 0, 0, 0});
+  assert(shared->_seq.load() == 22);
+  assert(shared->_book._self_trade_modes[1] == SelfTradeMode::CANCEL_RESTING);
+  assert(shared->_book._risk[1].max_order_quantity == 10);
+
+  close_shared_orderbook(shared);
+  assert(unlink_shared_orderbook(name.c_str()));
+  assert(open_shared_orderbook(name.c_str()) == nullptr);
+
+  std::cout << "Test 33 passed." << std::endl;
+}
+
+#if ENGINE_RISK_CHECKS
+// Test 34: Pre-trade risk limits and position tracking
+void test_risk_limits() {
+  std::cout << "Test 34: Pre-trade risk limits" << std::endl;
+  Orderbook ob;
+  const ParticipantType maker = 1, taker = 2;
+  set_risk_limits(ob, taker, RiskLimits{50, 5, 3000, 60});
+
+  assert(match_order_as(ob, Order{150, 100, 40, Side::SELL}, maker) == 0);
+  assert(match_order_as(ob, Order{151, 110, 40, Side::SELL}, maker) == 0);
+
+  // Quantity, notional and band breaches are rejected and leave no trace.
+  assert(match_order_as(ob, Order{152, 100, 51, Side::BUY}, taker) ==
+         RISK_REJECTED);
+  assert(match_order_as(ob, Order{153, 101, 30, Side::BUY}, taker) ==
+         RISK_REJECTED); // notional 3030
+  assert(match_order_as(ob, Order{154, 94, 1, Side::BUY}, taker) ==
+         RISK_REJECTED); // 6 ticks from best ask 100
+  assert(!order_exists(ob, 152) && !order_exists(ob, 153) &&
+         !order_exists(ob, 154));
+  assert(get_volume_at_level(ob, Side::SELL, 100) == 40);
+
+  // Accepted fills move both participants' positions.
+  assert(match_order_as(ob, Order{155, 100, 25, Side::BUY}, taker) == 1);
+  assert(get_position(ob, taker) == 25);
+  assert(get_position(ob, maker) == -25);
+
+  // Position limit counts the filled position plus the new order.
+  assert(match_order_as(ob, Order{156, 100, 29, Side::BUY}, taker) == 1);
+  assert(get_position(ob, taker) == 40);
+  assert(match_order_as(ob, Order{157, 100, 21, Side::BUY}, taker) ==
+         RISK_REJECTED);
+  assert(match_order_as(ob, Order{158, 108, 20, Side::BUY}, taker) == 0);
+  assert(order_exists(ob, 158));
+
+  // The pipeline's prechecked entry leaves quantity and notional to its caller, but
+  // still checks position and price band.
+  assert(match_order_as(ob, Order{160, 110, 51, Side::SELL}, taker) ==
+         RISK_REJECTED);
+  assert(engine_detail::match_prechecked(
+             ob, Order{160, 110, 51, Side::SELL}, 0, taker) == 0);
+  assert(order_exists(ob, 160));
+  modify_order_by_id(ob, 160, 0);
+  assert(engine_detail::match_prechecked(
+             ob, Order{161, 108, 21, Side::BUY}, 0, taker) ==
+         RISK_REJECTED);
+  assert(engine_detail::match_prechecked(
+             ob, Order{162, 114, 1, Side::SELL}, 0, taker) ==
+         RISK_REJECTED); // 6 ticks from best bid 108
+
+  // Slots without limits (including match_order's slot 0) are unchecked.
+  assert(match_order(ob, Order{159, 1000, 60000, Side::BUY}) == 1);
+  assert(get_position(ob, 0) == 40);
+  assert(get_position(ob, maker) == -80);
+
+  // The band is measured from the best level with volume, not from one
+  // only lazily cancelled entries keep on the ladder.
+  std::unique_ptr<Orderbook> band(create_orderbook());
+  set_risk_limits(*band, taker, RiskLimits{50, 5, 3000, 60});
+  match_order_as(*band, Order{170, 100, 5, Side::SELL}, maker);
+  match_order_as(*band, Order{171, 110, 5, Side::SELL}, maker);
+  modify_order_by_id(*band, 170, 0);
+  assert(match_order_as(*band, Order{172, 104, 1, Side::BUY}, taker) ==
+         RISK_REJECTED); // 6 ticks from the live best ask 110
+  assert(match_order_as(*band, Order{173, 106, 1, Side::BUY}, taker) == 0);
+  assert(order_exists(*band, 173));
+
+  std::cout << "Test 34 passed." << std::endl;
+}
+#endif
+
+// Test 35: Self-trade prevention modes
+void test_self_trade_prevention() {
+  std::cout << "Test 35: Self-trade prevention modes" << std::endl;
+  const ParticipantType mm = 3, other = 4;
+
+  // Cancel resting: own order is pulled, matching continues behind it.
+  {
+    Orderbook ob;
+    set_self_trade_mode(ob, mm, SelfTradeMode::CANCEL_RESTING);
+    match_order_as(ob, Order{160, 100, 5, Side::SELL}, mm);
+    match_order_as(ob, Order{161, 100, 5, Side::SELL}, other);
+    assert(match_order_as(ob, Order{162, 100, 8, Side::BUY}, mm) == 1);
+    assert(!order_exists(ob, 160) && !order_exists(ob, 161));
+    assert(lookup_order_by_id(ob, 162).quantity == 3);
+    assert(get_volume_at_level(ob, Side::SELL, 100) == 0);
+    assert(get_volume_at_level(ob, Side::BUY, 100) == 3);
+  }
+
+  // Cancel aggressor: fills up to the own order, the rest is dropped.
+  {
+    Orderbook ob;
+    set_self_trade_mode(ob, mm, SelfTradeMode::CANCEL_AGGRESSOR);
+    match_order_as(ob, Order{170, 100, 5, Side::SELL}, other);
+    match_order_as(ob, Order{171, 100, 5, Side::SELL}, mm);
+    assert(match_order_as(ob, Order{172, 100, 8, Side::BUY}, mm) == 1);
+    assert(!order_exists(ob, 170) && !order_exists(ob, 172));
+    assert(lookup_order_by_id(ob, 171).quantity == 5);
+    assert(get_volume_at_level(ob, Side::SELL, 100) == 5);
+  }
+
+  // Decrement both: both shrink by the smaller quantity, no match.
+  {
+    Orderbook ob;
+    set_self_trade_mode(ob, mm, SelfTradeMode::DECREMENT_BOTH);
+    match_order_as(ob, Order{180, 100, 5, Side::SELL}, mm);
+    match_order_as(ob, Order{181, 101, 5, Side::SELL}, other);
+    assert(match_order_as(ob, Order{182, 101, 8, Side::BUY}, mm) == 1);
+    assert(!order_exists(ob, 180) && !order_exists(ob, 182));
+    assert(lookup_order_by_id(ob, 181).quantity == 2);
+    assert(get_volume_at_level(ob, Side::SELL, 100) == 0);
+    assert(get_volume_at_level(ob, Side::SELL, 101) == 2);
+  }
+
+  // A cancelled own order no longer arms the check, and slot 0 is exempt.
+  {
+    Orderbook ob;
+    set_self_trade_mode(ob, mm, SelfTradeMode::CANCEL_AGGRESSOR);
+    match_order_as(ob, Order{190, 100, 5, Side::SELL}, mm);
+    modify_order_by_id(ob, 190, 0);
+    match_order_as(ob, Order{191, 100, 5, Side::SELL}, other);
+    assert(match_order_as(ob, Order{192, 100, 5, Side::BUY}, mm) == 1);
+    match_order(ob, Order{193, 100, 5, Side::SELL});
+    assert(match_order(ob, Order{194, 100, 5, Side::BUY}) == 1);
+  }
+
+  // Orders resting before the mode is set (or while it was off) count too
+  {
+    Orderbook ob;
+    match_order_as(ob, Order{195, 100, 5, Side::SELL}, mm);
+    set_self_trade_mode(ob, mm, SelfTradeMode::CANCEL_AGGRESSOR);
+    assert(match_order_as(ob, Order{196, 100, 5, Side::BUY}, mm) == 0);
+    assert(lookup_order_by_id(ob, 195).quantity == 5);
+    set_self_trade_mode(ob, mm, SelfTradeMode::NONE);
+    match_order_as(ob, Order{197, 100, 5, Side::SELL}, mm);
+    set_self_trade_mode(ob, mm, SelfTradeMode::CANCEL_RESTING);
+    assert(match_order_as(ob, Order{198, 100, 10, Side::BUY}, mm) == 0);
+    assert(!order_exists(ob, 195) && !order_exists(ob, 197));
+    assert(lookup_order_by_id(ob, 198).quantity == 10);
+  }
+
+  std::cout << "Test 35 passed." << std::endl;
+}
+
+// Test 36: Interleaved matching gives the same results as sequential
+void test_interleaved_matcher() {
+  std::cout << "Test 36: Interleaved matching matches sequential" << std::endl;
+  constexpr int NUM_BOOKS = 3;
+  std::unique_ptr<Orderbook> seq[NUM_BOOKS], inter[NUM_BOOKS];
+  for (int b = 0; b < NUM_BOOKS; ++b) {
+    seq[b].reset(create_orderbook());
+    inter[b].reset(create_orderbook());
+  }
+
+  // Consecutive requests often hit the same book and cross each other.
+  std::vector<MatchRequest> seq_requests, inter_requests;
+  uint32_t state = 12345;
+  for (IdType id = 1; id < 400; ++id) {
+    state = state * 1103515245 + 12345;
+    const int book = (state >> 8) % NUM_BOOKS;
+    const Side side = (state >> 12) & 1 ? Side::SELL : Side::BUY;
+    const PriceType price = 95 + (state >> 16) % 10;
+    const QuantityType qty = 1 + (state >> 20) % 9;
+    seq_requests.push_back({seq[book].get(), Order{id, price, qty, side}});
+    inter_requests.push_back({inter[book].get(), Order{id, price, qty, side}});
+  }
+
+  std::vector<uint32_t> expected(seq_requests.size());
+  for (size_t i = 0; i < seq_requests.size(); ++i)
+    expected[i] = match_order(*seq_requests[i].book, seq_requests[i].order);
+
+  std::vector<uint32_t> results(inter_requests.size());
+  InterleavedMatcher matcher(5);
+  matcher.run(inter_requests.data(), inter_requests.size(), results.data());
+
+  assert(results == expected);
+  for (int b = 0; b < NUM_BOOKS; ++b)
+    for (PriceType p = 95; p < 105; ++p) {
+      assert(get_volume_at_level(*seq[b], Side::BUY, p) ==
+             get_volume_at_level(*inter[b], Side::BUY, p));
+      assert(get_volume_at_level(*seq[b], Side::SELL, p) ==
+             get_volume_at_level(*inter[b], Side::SELL, p));
+    }
+
+  std::cout << "Test 36 passed." << std::endl;
+}
+
+// Test 37: Journaled operations are durable and replay into a fresh book
+void test_journal_replay() {
+  std::cout << "Test 37: Journal group commit and replay" << std::endl;
+  const std::string path =
+      "/tmp/lll-journal-" + std::to_string(getpid()) + ".bin";
+  std::remove(path.c_str());
+
+  Orderbook live;
+  uint64_t last = 0;
+  {
+    Journal journal(path.c_str(), std::chrono::microseconds(200));
+    journaled_match_order(journal, live, Order{200, 100, 10, Side::SELL});
+    journaled_match_order(journal, live, Order{201, 101, 5, Side::SELL});
+    journaled_match_order(journal, live, Order{202, 101, 17, Side::BUY});
+    journaled_modify_order_by_id(journal, live, 201, 0); // already filled
+    journaled_modify_order_by_id(journal, live, 202, 1);
+    journaled_match_order(journal, live, Order{203, 99, 4, Side::BUY});
+    // The fully filled order's modify is not an accepted operation.
+    assert(journal.wait_durable(4));
+    assert(journal.durable_sequence() >= 4);
+    assert(!journal.failed());
+  }
+
+  // The destructor drains and syncs everything appended.
+  Orderbook *replayed = create_orderbook();
+  last = replay_journal(path.c_str(), *replayed);
+  assert(last == 5);
+  for (PriceType p = 98; p < 103; ++p) {
+    assert(get_volume_at_level(*replayed, Side::BUY, p) ==
+           get_volume_at_level(live, Side::BUY, p));
+    assert(get_volume_at_level(*replayed, Side::SELL, p) ==
+           get_volume_at_level(live, Side::SELL, p));
+  }
+  assert(lookup_order_by_id(*replayed, 202).quantity == 1);
+  assert(!order_exists(*replayed, 200) && !order_exists(*replayed, 201));
+  delete replayed;
+
+  // Reopening continues the sequence; a corrupt whole record and a torn
+  // partial one at the tail are both dropped.
+  {
+    FILE *f = std::fopen(path.c_str(), "ab");
+    const std::string garbage(sizeof(JournalRecord), '\xab');
+    std::fwrite(garbage.data(), 1, garbage.size(), f);
+    std::fputs("torn", f);
+    std::fclose(f);
+    Journal journal(path.c_str(), std::chrono::microseconds(200));
+    // Heap books: the journal's ring already takes 2 MB of stack.
+    std::unique_ptr<Orderbook> book(create_orderbook());
+    replay_journal(path.c_str(), *book);
+    journaled_match_order(journal, *book, Order{204, 100, 1, Side::BUY});
+  }
+  std::unique_ptr<Orderbook> again(create_orderbook());
+  assert(replay_journal(path.c_str(), *again) == 6);
+  assert(get_volume_at_level(*again, Side::BUY, 100) == 1);
+
+  // A file that is not a journal is refused and left as it was
+  {
+    FILE *f = std::fopen(path.c_str(), "wb");
+    const std::string text(5 * sizeof(JournalRecord) + 3, 'x');
+    std::fwrite(text.data(), 1, text.size(), f);
+    std::fclose(f);
+    bool threw = false;
+    try {
+      Journal journal(path.c_str(), std::chrono::microseconds(200));
+    } catch (const std::runtime_error &) {
+      threw = true;
+    }
+    assert(threw);
+    struct stat st;
+    assert(stat(path.c_str(), &st) == 0 &&
+           st.st_size == static_cast<off_t>(text.size()));
+  }
+
+  // A write error fails the journal without hanging its destructor
+  {
+    Journal journal("/dev/full", std::chrono::microseconds(200));
+    const uint64_t sequence = journal.append(JournalRecord{});
+    assert(!journal.wait_durable(sequence));
+    assert(journal.failed());
+  }
+
+  std::remove(path.c_str());
+  std::cout << "Test 37 passed." << std::endl;
+}
+
+// Test 46: An auction and its uncross replay from the journal
+void test_journal_auction_replay() {
+  std::cout << "Test 46: Journal replays auctions" << std::endl;
+  const std::string path =
+      "/tmp/lll-journal-auction-" + std::to_string(getpid()) + ".bin";
+  std::remove(path.c_str());
+
+  std::unique_ptr<Orderbook> live(create_orderbook());
+  {
+    Journal journal(path.c_str(), std::chrono::microseconds(200));
+    journaled_match_order(journal, *live, Order{200, 100, 5, Side::SELL});
+    journaled_begin_auction(journal, *live);
+    // Crosses the resting sell, but only rests until the uncross.
+    assert(journaled_match_order(journal, *live,
+                                 Order{201, 101, 8, Side::BUY}) == 0);
+    journaled_match_order(journal, *live, Order{202, 99, 2, Side::SELL});
+    assert(journaled_uncross(journal, *live) == 2);
+    // Continuous again: this one matches on arrival.
+    assert(journaled_match_order(journal, *live,
+                                 Order{203, 101, 4, Side::SELL}) == 1);
+    assert(journal.wait_durable(6));
+  }
+
+  std::unique_ptr<Orderbook> replayed(create_orderbook());
+  assert(replay_journal(path.c_str(), *replayed) == 6);
+  assert(!replayed->_in_auction);
+  for (IdType id = 200; id <= 203; ++id)
+    assert(order_exists(*replayed, id) == order_exists(*live, id));
+  assert(lookup_order_by_id(*replayed, 203).quantity == 3);
+  for (PriceType p = 98; p < 103; ++p) {
+    assert(get_volume_at_level(*replayed, Side::BUY, p) ==
+           get_volume_at_level(*live, Side::BUY, p));
+    assert(get_volume_at_level(*replayed, Side::SELL, p) ==
+           get_volume_at_level(*live, Side::SELL, p));
+  }
+
+  std::remove(path.c_str());
+  std::cout << "Test 46 passed." << std::endl;
+}
+
+// Test 47: Iceberg orders replay from the journal with their display size
+void test_journal_iceberg_replay() {
+  std::cout << "Test 47: Journal replays icebergs" << std::endl;
+  const std::string path =
+      "/tmp/lll-journal-iceberg-" + std::to_string(getpid()) + ".bin";
+  std::remove(path.c_str());
+
+  std::unique_ptr<Orderbook> live(create_orderbook());
+  {
+    Journal journal(path.c_str(), std::chrono::microseconds(200));
+    journaled_match_iceberg(journal, *live, Order{300, 100, 10, Side::SELL},
+                            3);
+    journaled_match_order(journal, *live, Order{301, 100, 2, Side::SELL});
+    // Takes the 3 shown, then 301's 2; the iceberg re-queues behind 301.
+    assert(journaled_match_order(journal, *live,
+                                 Order{302, 100, 5, Side::BUY}) == 2);
+    assert(journal.wait_durable(3));
+  }
+
+  std::unique_ptr<Orderbook> replayed(create_orderbook());
+  assert(replay_journal(path.c_str(), *replayed) == 3);
+  assert(get_volume_at_level(*replayed, Side::SELL, 100) == 3);
+  assert(get_total_volume_at_level(*replayed, Side::SELL, 100) == 7);
+  // The display size survives the replay: the next fill shows 3 again.
+  for (Orderbook *book : {live.get(), replayed.get()})
+    assert(match_order(*book, Order{303, 100, 4, Side::BUY}) == 2);
+  assert(get_volume_at_level(*replayed, Side::SELL, 100) ==
+         get_volume_at_level(*live, Side::SELL, 100));
+  assert(get_volume_at_level(*replayed, Side::SELL, 100) == 2);
+  assert(get_total_volume_at_level(*replayed, Side::SELL, 100) == 3);
+
+  std::remove(path.c_str());
+  std::cout << "Test 47 passed." << std::endl;
+}
+
+// Test 48: Risk limits and self-trade modes replay in sequence with orders
+void test_journal_config_replay() {
+  std::cout << "Test 48: Journal replays configuration changes" << std::endl;
+  const std::string path =
+      "/tmp/lll-journal-config-" + std::to_string(getpid()) + ".bin";
+  std::remove(path.c_str());
+
+  std::unique_ptr<Orderbook> live(create_orderbook());
+  {
+    Journal journal(path.c_str(), std::chrono::microseconds(200));
+    journaled_match_order(journal, *live, Order{400, 100, 5, Side::SELL}, 1);
+    journaled_set_self_trade_mode(journal, *live, 1,
+                                  SelfTradeMode::CANCEL_RESTING);
+    // Cancels 400 instead of trading with it; without the mode record
+    // replay would count a match and throw.
+    assert(journaled_match_order(journal, *live,
+                                 Order{401, 100, 3, Side::BUY}, 1) == 0);
+    journaled_set_risk_limits(journal, *live, 2, RiskLimits{4, 0, 0, 50});
+    assert(journaled_match_order(journal, *live,
+                                 Order{402, 100, 2, Side::SELL}, 2) == 1);
+    assert(journal.wait_durable(5));
+  }
+
+  std::unique_ptr<Orderbook> replayed(create_orderbook());
+  assert(replay_journal(path.c_str(), *replayed) == 5);
+  assert(replayed->_self_trade_modes[1] == SelfTradeMode::CANCEL_RESTING);
+  for (ParticipantType p : {1, 2})
+    assert(std::memcmp(&replayed->_risk[p], &live->_risk[p],
+                       sizeof(live->_risk[p])) == 0);
+  assert(!order_exists(*replayed, 400));
+  assert(lookup_order_by_id(*replayed, 401).quantity == 1);
+
+  std::remove(path.c_str());
+  std::cout << "Test 48 passed." << std::endl;
+}
+
+// Test 38: Auction accumulates and uncrosses at the max-volume price
+void test_auction_uncross() {
+  std::cout << "Test 38: Auction uncross" << std::endl;
+  Orderbook ob;
+  begin_auction(ob);
+  assert(match_order(ob, Order{200, 102, 5, Side::BUY}) == 0);
+  assert(match_order(ob, Order{201, 101, 10, Side::BUY}) == 0);
+  assert(match_order(ob, Order{202, 99, 4, Side::BUY}) == 0);
+  assert(match_order(ob, Order{210, 98, 6, Side::SELL}) == 0);
+  assert(match_order(ob, Order{211, 100, 6, Side::SELL}) == 0);
+  assert(match_order(ob, Order{212, 101, 3, Side::SELL}) == 0);
+  assert(match_order(ob, Order{213, 103, 5, Side::SELL}) == 0);
+  assert(match_order(ob, Order{214, 99, 2, Side::SELL}) == 0);
+  modify_order_by_id(ob, 214, 0);
+  // Crossing orders rest untouched during the auction.
+  assert(order_exists(ob, 200) && order_exists(ob, 210));
+
+  // Executable volume: 6 @98, 6 @99, 12 @100, 15 @101, 5 @102.
+  PriceType price = 0;
+  uint32_t volume = 0;
+  assert(get_equilibrium(ob, price, volume));
+  assert(price == 101 && volume == 15);
+
+  // 200x210, 201x210, 201x211, 201x212
+  assert(uncross(ob) == 4);
+  for (IdType id : {200, 201, 210, 211, 212})
+    assert(!order_exists(ob, id));
+  assert(lookup_order_by_id(ob, 202).quantity == 4);
+  assert(lookup_order_by_id(ob, 213).quantity == 5);
+  for (PriceType p = 98; p <= 103; ++p) {
+    assert(get_volume_at_level(ob, Side::BUY, p) == (p == 99 ? 4 : 0));
+    assert(get_volume_at_level(ob, Side::SELL, p) == (p == 103 ? 5 : 0));
+  }
+  assert(!get_equilibrium(ob, price, volume));
+
+  // Back to continuous matching.
+  assert(match_order(ob, Order{220, 103, 2, Side::BUY}) == 1);
+  assert(lookup_order_by_id(ob, 213).quantity == 3);
+
+  // Equal volume and imbalance across 98..100: the middle price is used.
+  std::unique_ptr<Orderbook> tie(create_orderbook());
+  begin_auction(*tie);
+  match_order(*tie, Order{230, 100, 5, Side::BUY});
+  match_order(*tie, Order{231, 98, 5, Side::SELL});
+  assert(get_equilibrium(*tie, price, volume));
+  assert(price == 99 && volume == 5);
+  assert(uncross(*tie) == 1);
+  assert(!order_exists(*tie, 230) && !order_exists(*tie, 231));
+
+  // A crossed range spanning several volume blocks, with icebergs and lazy
+  // cancels, matches a direct price-by-price scan
+  std::mt19937 rng(38);
+  for (int round = 0; round < 20; ++round) {
+    std::unique_ptr<Orderbook> wide(create_orderbook());
+    begin_auction(*wide);
+    for (IdType id = 1; id < 600; ++id) {
+      const Side side = rng() % 2 ? Side::BUY : Side::SELL;
+      const auto p = static_cast<PriceType>(
+          side == Side::BUY ? 150 + rng() % 220 : 100 + rng() % 220);
+      const auto q = static_cast<QuantityType>(1 + rng() % 50);
+      if (rng() % 8 == 0)
+        match_iceberg_as(*wide, Order{id, p, q, side}, 3, 0);
+      else
+        match_order(*wide, Order{id, p, q, side});
+      if (rng() % 6 == 0)
+        modify_order_by_id(*wide, id, 0);
+    }
+
+    uint64_t best_key = 0;
+    PriceType first = 0, last = 0;
+    for (PriceType p = 100; p < 370; ++p) {
+      uint64_t demand = 0, supply = 0;
+      for (PriceType q = 100; q < 370; ++q) {
+        demand += q >= p ? get_total_volume_at_level(*wide, Side::BUY, q) : 0;
+        supply += q <= p ? get_total_volume_at_level(*wide, Side::SELL, q) : 0;
+      }
+      const uint64_t executed = std::min(demand, supply);
+      const uint64_t imbalance =
+          demand > supply ? demand - supply : supply - demand;
+      const uint64_t key = executed << 32 | (UINT32_MAX - imbalance);
+      if (key > best_key)
+        first = p;
+      if (key >= best_key)
+        last = p;
+      best_key = std::max(best_key, key);
+    }
+    assert(get_equilibrium(*wide, price, volume));
+    assert(volume == best_key >> 32);
+    assert(price == (first + last) / 2);
+  }
+
+  std::cout << "Test 38 passed." << std::endl;
+}
+
+// Test 39: Iceberg orders replenish at the back of their level
+void test_iceberg_orders() {
+  std::cout << "Test 39: Iceberg orders" << std::endl;
+  Orderbook ob;
+
+  // 25 total, 10 shown; a plain order queues behind it.
+  assert(match_iceberg_as(ob, Order{300, 100, 25, Side::SELL}, 10, 0) == 0);
+  match_order(ob, Order{301, 100, 5, Side::SELL});
+  assert(lookup_order_by_id(ob, 300).quantity == 10);
+  assert(get_volume_at_level(ob, Side::SELL, 100) == 15);
+  assert(get_total_volume_at_level(ob, Side::SELL, 100) == 30);
+
+  // Filling the shown 10 refills it behind 301, which trades next.
+  assert(match_order(ob, Order{302, 100, 12, Side::BUY}) == 2);
+  assert(lookup_order_by_id(ob, 300).quantity == 10);
+  assert(lookup_order_by_id(ob, 301).quantity == 3);
+  assert(get_volume_at_level(ob, Side::SELL, 100) == 13);
+  assert(get_total_volume_at_level(ob, Side::SELL, 100) == 18);
+
+  // 301 (3), 300 (10), last slice of 300 (5), then the rest buy rests.
+  assert(match_order(ob, Order{303, 100, 20, Side::BUY}) == 3);
+  assert(!order_exists(ob, 300) && !order_exists(ob, 301));
+  assert(get_total_volume_at_level(ob, Side::SELL, 100) == 0);
+  assert(get_volume_at_level(ob, Side::BUY, 100) == 2);
+
+  // Cancelling drops the reserve with the shown part.
+  match_iceberg_as(ob, Order{310, 90, 30, Side::BUY}, 5, 0);
+  assert(get_volume_at_level(ob, Side::BUY, 90) == 5);
+  assert(get_total_volume_at_level(ob, Side::BUY, 90) == 30);
+  modify_order_by_id(ob, 310, 0);
+  assert(get_total_volume_at_level(ob, Side::BUY, 90) == 0);
+  assert(!order_exists(ob, 310));
+
+  // An iceberg trades its full size on arrival and only the rest is hidden.
+  match_order(ob, Order{320, 110, 4, Side::SELL});
+  assert(match_iceberg_as(ob, Order{321, 110, 20, Side::BUY}, 6, 0) == 1);
+  assert(lookup_order_by_id(ob, 321).quantity == 6);
+  assert(get_total_volume_at_level(ob, Side::BUY, 110) == 16);
+
+  // A level keeps cycling orders past its queue capacity.
+  for (IdType i = 0; i < 2 * MAX_ORDERS_PER_LEVEL; ++i) {
+    match_order(ob, Order{400 + i, 120, 1, Side::SELL});
+    assert(match_order(ob, Order{500 + i, 120, 1, Side::BUY}) == 1);
+  }
+
+  // Reserves count towards the uncross and refill during it.
+  std::unique_ptr<Orderbook> auction(create_orderbook());
+  begin_auction(*auction);
+  match_iceberg_as(*auction, Order{330, 100, 20, Side::SELL}, 5, 0);
+  match_order(*auction, Order{331, 100, 15, Side::BUY});
+  PriceType price = 0;
+  uint32_t volume = 0;
+  assert(get_equilibrium(*auction, price, volume));
+  assert(price == 100 && volume == 15);
+  assert(uncross(*auction) == 3);
+  assert(!order_exists(*auction, 331));
+  assert(lookup_order_by_id(*auction, 330).quantity == 5);
+  assert(get_total_volume_at_level(*auction, Side::SELL, 100) == 5);
+
+  std::cout << "Test 39 passed." << std::endl;
+}
+
+// Test 40: Level queues take pool blocks only while they hold orders
+void test_level_queue_pool() {
+  std::cout << "Test 40: Level queue blocks follow live depth" << std::endl;
+  std::unique_ptr<Orderbook> ob(create_orderbook());
+  const auto &sells = ob->_levels[static_cast<size_t>(Side::SELL)].queues();
+
+  for (IdType i = 0; i < 8; ++i)
+    match_order(*ob, Order{600 + i, static_cast<PriceType>(200 + i), 1,
+                           Side::SELL});
+  assert(sells.blocks_in_use() == 8);
+
+  // Sweeping the levels hands their blocks back ...
+  assert(match_order(*ob, Order{610, 205, 6, Side::BUY}) == 6);
+  assert(sells.blocks_in_use() == 2);
+
+  // ... and new levels reuse them instead of touching fresh ones.
+  for (IdType i = 0; i < 6; ++i)
+    match_order(*ob, Order{620 + i, static_cast<PriceType>(300 + i), 1,
+                           Side::SELL});
+  assert(sells.blocks_in_use() == 8);
+  assert(sells.blocks_touched() == 8);
+
+  // Lazily cancelled entries hold a block until they are trimmed.
+  modify_order_by_id(*ob, 606, 0);
+  modify_order_by_id(*ob, 607, 0);
+  assert(sells.blocks_in_use() == 8);
+  assert(match_order(*ob, Order{630, 300, 1, Side::BUY}) == 1);
+  assert(sells.blocks_in_use() == 5);
+
+  std::cout << "Test 40 passed." << std::endl;
+}
+
+// Test 41: Resting opens a ladder entry once per level, and a full level
+// turns orders away, counting the drop instead of their volume
+void test_rest_path_level_creation() {
+  std::cout << "Test 41: Rest path creates each level once" << std::endl;
+  std::unique_ptr<Orderbook> ob(create_orderbook());
+  const OBSide &buys = ob->_levels[static_cast<size_t>(Side::BUY)];
+
+  for (IdType i = 0; i < MAX_ORDERS_PER_LEVEL; ++i)
+    match_order(*ob, Order{700 + i, 150, 2, Side::BUY});
+  match_order(*ob, Order{750, 149, 1, Side::BUY});
+  assert(buys.level_count() == 2);
+  assert(get_volume_at_level(*ob, Side::BUY, 150) == 2 * MAX_ORDERS_PER_LEVEL);
+
+  // Exactly MAX_ORDERS_PER_LEVEL fit; the next one is dropped and counted
+  assert(get_dropped_rests(*ob) == 0);
+  assert(match_order(*ob, Order{760, 150, 5, Side::BUY}) == 0);
+  assert(!order_exists(*ob, 760));
+  assert(get_volume_at_level(*ob, Side::BUY, 150) == 2 * MAX_ORDERS_PER_LEVEL);
+  assert(get_dropped_rests(*ob) == 1);
+
+  // The gateway reports the drop, so a client is not told its order rests
+  {
+    WireResponse response{};
+    const WireRequest request = wire_new_order(Order{761, 150, 1, Side::BUY});
+    apply_wire_request(*ob, request, response);
+    assert(response.status == WireStatus::LEVEL_FULL);
+    assert(response.matches == 0 && !order_exists(*ob, 761));
+    assert(get_dropped_rests(*ob) == 2);
+  }
+
+  // Clearing the level removes its single ladder entry
+  assert(match_order(*ob, Order{770, 150, 2 * MAX_ORDERS_PER_LEVEL,
+                                Side::SELL}) == MAX_ORDERS_PER_LEVEL);
+  assert(buys.level_count() == 1);
+  assert(buys.best_price() == 149);
+
+  std::cout << "Test 41 passed." << std::endl;
+}
+
+// Test 42: Gateway decodes a packet in place and answers each request
+void test_binary_gateway() {
+  std::cout << "Test 42: Binary gateway round trip" << std::endl;
+  std::unique_ptr<Orderbook> ob(create_orderbook());
+  int fds[2];
+  assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+  Gateway gateway(*ob, fds[1]);
+
+  WireRequest bad_price = wire_new_order(Order{803, 0, 1, Side::BUY});
+  bad_price.price = MAX_NUM_PRICES;
+  const WireRequest packet[] = {
+      wire_new_order(Order{800, 100, 10, Side::SELL}),
+      wire_new_order(Order{801, 100, 4, Side::BUY}),
+      wire_modify(802, 3),
+      wire_new_order(Order{800, 101, 1, Side::SELL}),
+      bad_price,
+      wire_new_order(Order{804, 101, 9, Side::SELL}, 0, 3),
+      wire_modify(800, 0),
+  };
+  assert(send(fds[0], packet, sizeof(packet), 0) == sizeof(packet));
+  assert(gateway.poll() == 7);
+
+  WireResponse responses[Gateway::MAX_BATCH];
+  assert(recv(fds[0], responses, sizeof(responses), 0) ==
+         7 * sizeof(WireResponse));
+  const WireStatus expected[] = {
+      WireStatus::ACCEPTED,     WireStatus::ACCEPTED,
+      WireStatus::UNKNOWN_ORDER, WireStatus::DUPLICATE_ID,
+      WireStatus::MALFORMED,    WireStatus::ACCEPTED,
+      WireStatus::ACCEPTED};
+  for (uint32_t i = 0; i < 7; ++i) {
+    assert(responses[i].status == expected[i]);
+    assert(responses[i].order_id == packet[i].order_id);
+    assert(responses[i].sequence == i);
+  }
+  assert(responses[1].matches == 1);
+  assert(!order_exists(*ob, 800));
+  assert(get_volume_at_level(*ob, Side::SELL, 101) == 3);
+  assert(get_total_volume_at_level(*ob, Side::SELL, 101) == 9);
+
+  // A torn packet is refused as a whole
+  assert(send(fds[0], packet, sizeof(WireRequest) + 3, 0) ==
+         sizeof(WireRequest) + 3);
+  assert(gateway.poll() == 1);
+  assert(recv(fds[0], responses, sizeof(responses), 0) ==
+         sizeof(WireResponse));
+  assert(responses[0].status == WireStatus::MALFORMED);
+  assert(!order_exists(*ob, 800));
+
+  // A cancelled id stays taken until its stale queue entry is trimmed,
+  // so a resubmission cannot revive it at the old level
+  std::unique_ptr<Orderbook> reuse_book(create_orderbook());
+  Gateway reuse(*reuse_book, -1);
+  const WireRequest reuse_stream[] = {
+      wire_new_order(Order{1, 100, 5, Side::SELL}),
+      wire_new_order(Order{2, 100, 5, Side::SELL}),
+      wire_modify(1, 0),
+      wire_new_order(Order{1, 105, 7, Side::SELL}),
+      wire_new_order(Order{9, 100, 5, Side::BUY}),
+      wire_new_order(Order{1, 105, 7, Side::SELL}),
+  };
+  reuse.handle(reuse_stream, 6, responses);
+  assert(responses[3].status == WireStatus::DUPLICATE_ID);
+  assert(responses[4].status == WireStatus::ACCEPTED &&
+         responses[4].matches == 1);
+  assert(responses[5].status == WireStatus::ACCEPTED);
+  assert(!order_exists(*reuse_book, 2) && !order_exists(*reuse_book, 9));
+  assert(get_volume_at_level(*reuse_book, Side::SELL, 100) == 0);
+  assert(lookup_order_by_id(*reuse_book, 1).quantity == 7);
+  assert(get_volume_at_level(*reuse_book, Side::SELL, 105) == 7);
+
+  close(fds[0]);
+  assert(gateway.poll() == 0);
+  close(fds[1]);
+  std::cout << "Test 42 passed." << std::endl;
+}
+
+#if ENGINE_QUEUE_POSITION
+// Test 43: Queue position counts live orders and volume ahead
+void test_queue_position() {
+  std::cout << "Test 43: Queue position" << std::endl;
+  std::unique_ptr<Orderbook> ob(create_orderbook());
+  QueuePosition position{};
+  assert(!queue_position(*ob, 900, position));
+
+  for (IdType i = 0; i < 5; ++i)
+    match_order(*ob, Order{900 + i, 100, 10, Side::SELL});
+  assert(queue_position(*ob, 900, position));
+  assert(position.orders_ahead == 0 && position.volume_ahead == 0);
+  assert(queue_position(*ob, 904, position));
+  assert(position.orders_ahead == 4 && position.volume_ahead == 40);
+
+  // A partial fill of the front, a cancel and a resize ahead
+  assert(match_order(*ob, Order{910, 100, 3, Side::BUY}) == 1);
+  modify_order_by_id(*ob, 902, 0);
+  modify_order_by_id(*ob, 901, 25);
+  assert(queue_position(*ob, 904, position));
+  assert(position.orders_ahead == 3 && position.volume_ahead == 7 + 25 + 10);
+  assert(queue_position(*ob, 903, position));
+  assert(position.orders_ahead == 2 && position.volume_ahead == 32);
+
+  // An iceberg refill goes to the back
+  match_iceberg_as(*ob, Order{905, 100, 12, Side::SELL}, 4, 0);
+  assert(match_order(*ob, Order{911, 100, 7 + 25 + 10 + 10, Side::BUY}) == 4);
+  assert(queue_position(*ob, 905, position));
+  assert(position.orders_ahead == 0 && position.volume_ahead == 0);
+  assert(match_order(*ob, Order{912, 100, 4, Side::BUY}) == 1);
+  match_order(*ob, Order{906, 100, 6, Side::SELL});
+  assert(queue_position(*ob, 906, position));
+  assert(position.orders_ahead == 1 && position.volume_ahead == 4);
+
+  // Random flow on a few levels against a shadow FIFO per level
+  std::unique_ptr<Orderbook> book(create_orderbook());
+  std::mt19937 rng(5);
+  std::vector<std::vector<IdType>> shadow(2 * MAX_NUM_PRICES);
+  std::vector<IdType> placed;
+  for (IdType id = 0; id < 4000; ++id) {
+    const uint32_t action = rng() % 10;
+    if (action < 3 && !placed.empty()) {
+      const IdType target = placed[rng() % placed.size()];
+      modify_order_by_id(*book, target,
+                         action == 0 ? 0 : static_cast<QuantityType>(1 + rng() % 30));
+    } else {
+      const Side side = rng() & 1 ? Side::BUY : Side::SELL;
+      const PriceType price = static_cast<PriceType>(
+          side == Side::BUY ? 100 + rng() % 6 : 103 + rng() % 6);
+      match_order(*book, Order{id, price,
+                               static_cast<QuantityType>(1 + rng() % 20), side});
+      if (order_exists(*book, id)) {
+        shadow[static_cast<size_t>(side) * MAX_NUM_PRICES + price].push_back(id);
+        placed.push_back(id);
+      }
+    }
+
+    for (const std::vector<IdType> &level : shadow) {
+      uint32_t orders = 0, volume = 0;
+      for (IdType queued : level) {
+        if (!order_exists(*book, queued))
+          continue;
+        assert(queue_position(*book, queued, position));
+        assert(position.orders_ahead == orders);
+        assert(position.volume_ahead == volume);
+        ++orders;
+        volume += lookup_order_by_id(*book, queued).quantity;
+      }
+    }
+  }
+
+  std::cout << "Test 43 passed." << std::endl;
+}
+#endif
+
+static void collect_responses(const WireResponse *responses, std::size_t count,
+                              void *context) {
+  auto &out = *static_cast<std::vector<WireResponse> *>(context);
+  out.insert(out.end(), responses, responses + count);
+}
+
+// Test 44: The staged pipeline publishes what the gateway would, in order
+void test_staged_pipeline() {
+  std::cout << "Test 44: Staged pipeline matches inline handling" << std::endl;
+  std::mt19937 rng(9);
+  std::vector<WireRequest> stream;
+  for (IdType id = 0; stream.size() < 6000; ++id) {
+    if (rng() % 4 == 0) {
+      stream.push_back(wire_modify(rng() % (id + 1),
+                                   static_cast<QuantityType>(rng() % 15)));
+      continue;
+    }
+    const Side side = rng() & 1 ? Side::BUY : Side::SELL;
+    const PriceType price = static_cast<PriceType>(
+        side == Side::BUY ? 200 + rng() % 8 : 205 + rng() % 8);
+    const ParticipantType participant = static_cast<ParticipantType>(rng() % 4);
+    WireRequest request = wire_new_order(
+        Order{id % MAX_ORDERS, price, static_cast<QuantityType>(1 + rng() % 60),
+              side},
+        participant, rng() % 8 == 0 ? 5 : 0);
+    if (rng() % 50 == 0)
+      request.reserved = 1; // malformed
+    stream.push_back(request);
+  }
+
+  const RiskLimits limits{40, 0, 0, 0};
+  std::unique_ptr<Orderbook> inline_book(create_orderbook());
+  std::unique_ptr<Orderbook> staged_book(create_orderbook());
+  set_risk_limits(*inline_book, 3, limits);
+  set_risk_limits(*staged_book, 3, limits);
+
+  // Halfway through, participant 2 gets a quantity limit too
+  const std::size_t change = stream.size() / 2;
+  const RiskLimits tightened{20, 0, 0, 0};
+  std::vector<WireResponse> expected(stream.size());
+  Gateway gateway(*inline_book, -1);
+  gateway.handle(stream.data(), change, expected.data());
+  set_risk_limits(*inline_book, 2, tightened);
+  gateway.handle(stream.data() + change, stream.size() - change,
+                 expected.data() + change);
+
+  std::vector<WireResponse> published;
+  {
+    auto pipeline = std::make_unique<Pipeline>(
+        *staged_book, collect_responses, &published, Pipeline::Cpus{});
+    // Uneven chunks, and more than a ring's worth in flight
+    for (std::size_t i = 0; i < stream.size();) {
+      const std::size_t end = i < change ? change : stream.size();
+      const std::size_t n = std::min<std::size_t>(1 + rng() % 700, end - i);
+      pipeline->submit(&stream[i], n);
+      i += n;
+      if (i == change)
+        pipeline->set_risk_limits(2, tightened);
+    }
+    pipeline->drain();
+    assert(published.size() == stream.size());
+  }
+
+  bool risk_rejected = false, tightened_rejected = false;
+  for (std::size_t i = 0; i < stream.size(); ++i) {
+    assert(std::memcmp(&published[i], &expected[i], sizeof(WireResponse)) == 0);
+    const bool rejected = published[i].status == WireStatus::RISK_REJECTED;
+    risk_rejected |= rejected;
+    tightened_rejected |= rejected && stream[i].participant == 2;
+    assert(!(rejected && stream[i].participant == 2 && i < change));
+  }
+  assert(risk_rejected == RISK_CHECKS);
+  assert(tightened_rejected == RISK_CHECKS);
+  for (PriceType price = 195; price < 220; ++price)
+    for (Side side : {Side::BUY, Side::SELL})
+      assert(get_total_volume_at_level(*staged_book, side, price) ==
+             get_total_volume_at_level(*inline_book, side, price));
+
+  std::cout << "Test 44 passed." << std::endl;
+}
+
+#if ENGINE_FLIGHT_RECORDER
+static uint32_t slow_ops = 0;
+
+static void count_slow_op(const FlightRecord &) { ++slow_ops; }
+
+// Test 45: Every op leaves a flight record of what it did to the book
+void test_flight_recorder() {
+  std::cout << "Test 45: Flight recorder" << std::endl;
+  std::unique_ptr<Orderbook> book(create_orderbook());
+  FlightRecord records[FlightRecorder::CAPACITY];
+
+  (void)match_order(*book, Order{1, 100, 3, Side::SELL});
+  (void)match_order(*book, Order{3, 101, 4, Side::SELL});
+  modify_order_by_id(*book, 3, 0);
+  (void)match_order(*book, Order{2, 101, 5, Side::SELL});
+  // Crosses 100 and 101, trimming the cancelled order 3 on the way
+  assert(match_order(*book, Order{4, 101, 8, Side::BUY}) == 2);
+  (void)match_order(*book, Order{5, 99, 2, Side::BUY});
+  modify_order_by_id(*book, 5, 1);
+  // Rejected when risk checks are built in, rests otherwise
+  set_risk_limits(*book, 2, RiskLimits{5, 0, 0, 0});
+  assert(match_order_as(*book, Order{6, 99, 10, Side::BUY}, 2) ==
+         (RISK_CHECKS ? RISK_REJECTED : 0));
+  begin_auction(*book);
+  (void)match_order(*book, Order{7, 110, 4, Side::BUY});
+  (void)match_order(*book, Order{8, 105, 4, Side::SELL});
+  assert(uncross(*book) == 1);
+
+  assert(flight_records(records, 7) == 7);
+  const FlightRecord &cross = records[0];
+  assert(cross.op == FlightOp::MATCH && cross.order_id == 4);
+  assert(cross.side == Side::BUY && cross.price == 101 && cross.quantity == 8);
+  assert(cross.matches == 2 && cross.levels_crossed == 2);
+  assert(cross.trimmed == 1 && cross.queue_depth == 0);
+
+  assert(records[1].op == FlightOp::MATCH && records[1].queue_depth == 1);
+  assert(records[1].levels_crossed == 0 && records[1].matches == 0);
+
+  const FlightRecord &modify = records[2];
+  assert(modify.op == FlightOp::MODIFY && modify.order_id == 5);
+  assert(modify.price == 99 && modify.quantity == 1);
+  assert(modify.queue_depth == 1);
+
+  assert(records[3].matches == (RISK_CHECKS ? FLIGHT_RISK_REJECTED : 0));
+  assert(records[3].participant == 2);
+  assert(records[4].order_id == 7 && records[4].queue_depth == 1);
+
+  assert(records[5].order_id == 8 && records[5].matches == 0);
+
+  const FlightRecord &auction = records[6];
+  assert(auction.op == FlightOp::UNCROSS && auction.matches == 1);
+  assert(auction.quantity == 4);
+  // One op in FLIGHT_TIMING_INTERVAL reads the clock
+  const uint64_t first = flight_detail::recorder.written - 7;
+  for (uint64_t i = 0; i < 7; ++i)
+    assert((records[i].entry != 0) ==
+           ((first + i) % FLIGHT_TIMING_INTERVAL == 0));
+
+  // The ring keeps the latest CAPACITY records
+  for (IdType id = 10; id < 10 + 2 * FlightRecorder::CAPACITY; ++id)
+    modify_order_by_id(*book, id, 1);
+  assert(flight_records(records, FlightRecorder::CAPACITY + 1) ==
+         FlightRecorder::CAPACITY);
+  assert(records[0].order_id == 10 + FlightRecorder::CAPACITY);
+  assert(records[FlightRecorder::CAPACITY - 1].order_id ==
+         9 + 2 * FlightRecorder::CAPACITY);
+
+  // A timed record gets its cycles when the next timed op starts, and
+  // those are what the trigger sees
+  const size_t count = flight_records(records, FlightRecorder::CAPACITY);
+  const uint64_t oldest = flight_detail::recorder.written - count;
+  const size_t timed =
+      (FLIGHT_TIMING_INTERVAL - oldest % FLIGHT_TIMING_INTERVAL) %
+      FLIGHT_TIMING_INTERVAL;
+  assert(records[timed].entry != 0 && records[timed].cycles != 0);
+  assert(records[timed + FLIGHT_TIMING_INTERVAL].entry >
+         records[timed].entry);
+  assert(records[count - 1].cycles == 0);
+
+  // A zero threshold triggers once per timed op; clearing the trigger
+  // stops it
+  set_flight_trigger(0, count_slow_op);
+  for (uint32_t i = 0; i < FLIGHT_TIMING_INTERVAL; ++i)
+    modify_order_by_id(*book, 5, 2);
+  assert(slow_ops == 1);
+  set_flight_trigger(0, nullptr);
+  for (uint32_t i = 0; i < FLIGHT_TIMING_INTERVAL; ++i)
+    modify_order_by_id(*book, 5, 1);
+  assert(slow_ops == 1);
+
+  std::cout << "Test 45 passed." << std::endl;
+}
+#endif
+
 int main() {
   test_lookup_order();
   test_simple_match_and_modify();
@@ -745,6 +1878,32 @@ int main() {
   test_get_volume_complex2();
   test_get_volume_complex3();
   test_get_volume_all_encompassing();
+  test_volume_up_to_price();
+  test_volume_within_ticks();
+  test_price_for_quantity();
+  test_modify_after_cancel_is_ignored();
+  test_shared_orderbook_reader();
+#if ENGINE_RISK_CHECKS
+  test_risk_limits();
+#endif
+  test_self_trade_prevention();
+  test_interleaved_matcher();
+  test_journal_replay();
+  test_journal_auction_replay();
+  test_journal_iceberg_replay();
+  test_journal_config_replay();
+  test_auction_uncross();
+  test_iceberg_orders();
+  test_level_queue_pool();
+  test_rest_path_level_creation();
+  test_binary_gateway();
+#if ENGINE_QUEUE_POSITION
+  test_queue_position();
+#endif
+  test_staged_pipeline();
+#if ENGINE_FLIGHT_RECORDER
+  test_flight_recorder();
+#endif
   std::cout << "All tests passed." << std::endl;
   return 0;
 }